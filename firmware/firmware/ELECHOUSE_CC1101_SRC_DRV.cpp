@@ -1137,6 +1137,52 @@ lqi=SpiReadStatus(CC1101_LQI);
 return lqi;
 }
 /****************************************************************
+*FUNCTION NAME:GDO Mode
+*FUNCTION     :Set the signal output on GDO0, GDO1 or GDO2
+*INPUT        :gdo: 0-2 cfg: IOCFGx GDOx_CFG value (0x0D async data, 0x0E carrier sense)
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setGDOMode(byte gdo, byte cfg)
+{
+if (gdo>2){gdo=2;}
+SpiWriteReg(CC1101_IOCFG0-gdo, cfg & 0x3F);
+}
+/****************************************************************
+*FUNCTION NAME:Carrier Sense
+*FUNCTION     :Set the carrier sense thresholds
+*INPUT        :absthr: dB relative to the AGC magnitude target, -7 to 7, -8 = off
+*              relthr: 0 = off, 1 = 6dB, 2 = 10dB, 3 = 14dB increase of RSSI
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setCarrierSense(int absthr, byte relthr)
+{
+if (absthr<-8){absthr=-8;}
+if (absthr>7){absthr=7;}
+if (relthr>3){relthr=3;}
+byte agc = SpiReadReg(CC1101_AGCCTRL1) & 0x40;
+SpiWriteReg(CC1101_AGCCTRL1, agc | (relthr<<4) | (absthr & 0x0F));
+}
+/****************************************************************
+*FUNCTION NAME:Carrier Sense State
+*FUNCTION     :Read the carrier sense flag
+*INPUT        :none
+*OUTPUT       :true when the RSSI is above the carrier sense threshold
+****************************************************************/
+bool ELECHOUSE_CC1101::getCarrierSense(void)
+{
+return (SpiReadStatus(CC1101_PKTSTATUS) & 0x40) != 0;
+}
+/****************************************************************
+*FUNCTION NAME:Frequency Offset Estimate
+*FUNCTION     :Read the carrier offset seen by the demodulator
+*INPUT        :none
+*OUTPUT       :offset in steps of f_xosc/2^14 (1.587 kHz at 26 MHz)
+****************************************************************/
+int8_t ELECHOUSE_CC1101::getFreqEst(void)
+{
+return (int8_t)SpiReadStatus(CC1101_FREQEST);
+}
+/****************************************************************
 *FUNCTION NAME:SetSres
 *FUNCTION     :Reset CC1101
 *INPUT        :none
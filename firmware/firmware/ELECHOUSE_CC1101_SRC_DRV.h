@@ -152,6 +152,10 @@ public:
   void SetRx(float mhz);
    int getRssi(void);
   byte getLqi(void);
+  void setGDOMode(byte gdo, byte cfg);
+  void setCarrierSense(int absthr, byte relthr);
+  bool getCarrierSense(void);
+  int8_t getFreqEst(void);
   void setSres(void);
   void setSidle(void);
   void goSleep(void);
@@ -0,0 +1,898 @@
+/*
+  analyzer.h - Pulse width clustering of a captured frame
+
+  pulseCluster() groups the pulse widths of a frame into timing classes. A
+  first pass marks the widths in a histogram of an eighth of the error
+  tolerance per bin. Walking it from the shortest width, every class spans
+  the tolerance from its first bin, like the windows of the old multi-pass
+  search in signalanalyse(). A second pass sums the pulses per class. So
+  the classes do not depend on the order of the pulses, and each pulse
+  costs a division and a table lookup per pass. The classes come out
+  ordered by count, so classes[0].mean is the symbol time.
+
+  lineDecode() names the line code of a message. Pulses are counted in units
+  of the shortest common class and a few histograms show whether the pairs
+  keep a constant period (PWM), a constant high (PPM) or the pulses stay at
+  one or two half bits (Manchester). Two passes over the message, no
+  allocation, so it runs on every capture.
+
+  FrameVote lines up the repeats of a frame. Each repeat is slid a few bits
+  against the majority so far and counted when it agrees well enough; the
+  result is one frame with the share of repeats behind every bit.
+  frameAnalyse() is the pass of signalanalyse() that puts these together:
+  cluster, symbol time, quantization and the vote over the repeats.
+
+  rateEstimate() and bandwidthEstimate() turn the symbol time into CC1101
+  data rate and receive filter settings for the auto-tune mode, FreqSamples
+  collects the FREQEST readings of the FSK estimate.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef ANALYZER_h
+#define ANALYZER_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "pulses.h"
+
+#define PULSE_CLASSES     10            // classes reported, as many as signalanalyse() kept
+#define PULSE_SLOTS       32            // classes tracked while reading the frame
+#define PULSE_BIN_STEPS   8             // histogram bins per tolerance
+#define PULSE_LINEAR_BITS 8             // 256 bins of tolerance / PULSE_BIN_STEPS, 1/8 octave after them
+#define PULSE_LINEAR_BINS (1 << PULSE_LINEAR_BITS)
+#define PULSE_BINS        (PULSE_LINEAR_BINS + 8 * (30 - PULSE_LINEAR_BITS))  // up to PULSE_DURATION
+#define PULSE_NO_CLASS    0xFF          // bin past the PULSE_SLOTS classes
+
+typedef struct {
+  uint32_t min;
+  uint32_t max;
+  uint32_t count;
+  uint32_t sum;
+  uint32_t mean;
+} PulseClass;
+
+typedef struct {
+  PulseClass classes[PULSE_CLASSES];
+  int count;                            // classes in use
+  uint32_t shortest;                    // shortest pulse of the frame
+  uint32_t unclustered;                 // pulses past the longest of PULSE_SLOTS classes
+} PulseClasses;
+
+// Adds one pulse width to the class it fits, or opens a new one. Returns the
+// class used, -1 when all are taken.
+static inline int pulseClassAdd(PulseClass *slots, int *used, uint32_t duration, uint32_t tolerance, uint32_t *unclustered) {
+  for (int s = 0; s < *used; s++) {
+    PulseClass *c = &slots[s];
+    uint32_t lo = duration < c->min ? duration : c->min;
+    uint32_t hi = duration > c->max ? duration : c->max;
+    if (hi - lo < tolerance) {
+      c->min = lo;
+      c->max = hi;
+      c->count++;
+      c->sum += duration;
+      return s;
+    }
+  }
+  if (*used == PULSE_SLOTS) {
+    (*unclustered)++;
+    return -1;
+  }
+  PulseClass *c = &slots[*used];
+  c->min = duration;
+  c->max = duration;
+  c->count = 1;
+  c->sum = duration;
+  return (*used)++;
+}
+
+// Histogram bin of a pulse width. The first PULSE_LINEAR_BINS are step wide,
+// longer widths go to bins of 1/8 octave.
+static inline int pulseBin(uint32_t duration, uint32_t step) {
+  uint32_t q = duration / step;
+
+  if (q < PULSE_LINEAR_BINS) {
+    return q;
+  }
+  int e = 31 - __builtin_clz(q) - PULSE_LINEAR_BITS;
+  return PULSE_LINEAR_BINS + e * 8 + ((q >> (e + PULSE_LINEAR_BITS - 3)) & 7);
+}
+
+// Shortest width of a bin, for bins up to PULSE_BINS.
+static inline uint64_t pulseBinLow(int bin, uint32_t step) {
+  if (bin < PULSE_LINEAR_BINS) {
+    return (uint64_t)bin * step;
+  }
+  int e = (bin - PULSE_LINEAR_BINS) / 8;
+  int m = (bin - PULSE_LINEAR_BINS) % 8;
+  return ((uint64_t)(8 + m) << (e + PULSE_LINEAR_BITS - 3)) * step;
+}
+
+// Clusters the pulses of an encoded frame, skipping the lead-in at index 0.
+// Returns the number of pulses read.
+static inline size_t pulseCluster(const uint16_t *words, size_t len, uint32_t tolerance, PulseClasses *out) {
+  uint8_t bins[PULSE_BINS];             // 1 when a bin is used, then its class + 1
+  PulseClass slots[PULSE_SLOTS];
+  uint32_t step = tolerance / PULSE_BIN_STEPS > 0 ? tolerance / PULSE_BIN_STEPS : 1;
+  int used = 0;
+  size_t pulses = 0;
+  PulseReader rd;
+  uint32_t pulse;
+
+  out->count = 0;
+  out->shortest = PULSE_DURATION;
+  out->unclustered = 0;
+  memset(bins, 0, sizeof(bins));
+
+  pulseReaderInit(&rd, words, len);
+  pulseNext(&rd, &pulse);
+  while (pulseNext(&rd, &pulse)) {
+    uint32_t duration = PULSE_TIME(pulse);
+    if (duration < out->shortest) {
+      out->shortest = duration;
+    }
+    bins[pulseBin(duration, step)] = 1;
+    pulses++;
+  }
+
+  // From the shortest width up, a class takes the bins that end within the
+  // tolerance of its first one
+  for (int b = 0; b < PULSE_BINS;) {
+    if (!bins[b]) {
+      b++;
+      continue;
+    }
+    uint64_t start = pulseBinLow(b, step);
+    uint8_t c = used < PULSE_SLOTS ? ++used : PULSE_NO_CLASS;
+    do {
+      bins[b++] = c;
+    } while (b < PULSE_BINS && pulseBinLow(b + 1, step) - start <= tolerance);
+  }
+
+  for (int s = 0; s < used; s++) {
+    slots[s].count = 0;
+    slots[s].sum = 0;
+  }
+  pulseReaderInit(&rd, words, len);
+  pulseNext(&rd, &pulse);
+  while (pulseNext(&rd, &pulse)) {
+    uint32_t duration = PULSE_TIME(pulse);
+    uint8_t c = bins[pulseBin(duration, step)];
+    if (c == PULSE_NO_CLASS) {
+      out->unclustered++;
+      continue;
+    }
+    PulseClass *slot = &slots[c - 1];
+    if (slot->count == 0 || duration < slot->min) {
+      slot->min = duration;
+    }
+    if (slot->count == 0 || duration > slot->max) {
+      slot->max = duration;
+    }
+    slot->count++;
+    slot->sum += duration;
+  }
+
+  // Keep the most frequent classes, ties go to the shorter width
+  while (out->count < PULSE_CLASSES && used > 0) {
+    int best = 0;
+    for (int s = 1; s < used; s++) {
+      if (slots[s].count > slots[best].count || (slots[s].count == slots[best].count && slots[s].min < slots[best].min)) {
+        best = s;
+      }
+    }
+    PulseClass *c = &out->classes[out->count++];
+    *c = slots[best];
+    c->mean = c->sum / c->count;
+    slots[best] = slots[--used];
+  }
+  return pulses;
+}
+
+// Rounds pulse widths to a whole number of symbols, half up, like the float
+// rounding signalanalyse() used. The reciprocal of the symbol time is taken
+// once per frame so each pulse costs a multiply and at most one correction.
+typedef struct {
+  uint32_t symbol;
+  uint64_t recip;                       // floor(2^32 / symbol)
+} SymbolQuantizer;
+
+static inline void quantizerInit(SymbolQuantizer *q, uint32_t symbol) {
+  q->symbol = symbol;
+  q->recip = (1ULL << 32) / symbol;
+}
+
+static inline uint32_t quantize(const SymbolQuantizer *q, uint32_t duration) {
+  // The estimate is the quotient or one less
+  uint32_t n = (uint32_t)((duration * q->recip) >> 32);
+  uint32_t rem = duration - n * q->symbol;
+
+  if (rem >= q->symbol) {
+    n++;
+    rem -= q->symbol;
+  }
+  return n + (2 * rem >= q->symbol);
+}
+
+// Streaming analysis of a frame while it is still being received. Pulses are
+// clustered as they arrive and collected into a message until a low period
+// of STREAM_PAUSE symbols or silence ends it; the message is then quantized
+// with the symbol time learned so far. Each pulse costs at most PULSE_SLOTS
+// compares, finishing a message at most STREAM_PULSES quantizations.
+#define STREAM_PULSES     192           // longest message in pulses
+#define STREAM_BITS       (STREAM_PULSES * 8)
+#define STREAM_PAUSE      8             // symbols of low that end a message, as signalanalyse() shows pauses
+#define STREAM_MIN_PULSES 16            // shorter messages are not reported
+
+typedef struct {
+  PulseClass slots[PULSE_SLOTS];
+  int used;
+  int best;                             // most frequent class so far
+  uint32_t unclustered;
+  uint32_t tolerance;
+
+  uint32_t pulses[STREAM_PULSES];       // current message
+  int count;
+  bool done;                            // pulses hold a finished message
+
+  // Finished message
+  uint32_t symbol;
+  uint8_t bits[STREAM_BITS / 8];        // symbol levels, first symbol in the top bit
+  int nbits;
+} StreamAnalyzer;
+
+static inline void streamReset(StreamAnalyzer *a, uint32_t tolerance) {
+  a->used = 0;
+  a->best = 0;
+  a->unclustered = 0;
+  a->tolerance = tolerance;
+  a->count = 0;
+  a->done = false;
+  a->nbits = 0;
+}
+
+// Symbol time learned so far, 0 before the first pulse.
+static inline uint32_t streamSymbol(const StreamAnalyzer *a) {
+  if (a->used == 0) {
+    return 0;
+  }
+  return a->slots[a->best].sum / a->slots[a->best].count;
+}
+
+static inline bool streamFinish(StreamAnalyzer *a) {
+  SymbolQuantizer q;
+  uint32_t symbol = streamSymbol(a);
+
+  if (a->count < STREAM_MIN_PULSES || symbol == 0) {
+    a->count = 0;
+    return false;
+  }
+
+  quantizerInit(&q, symbol);
+  a->symbol = symbol;
+  a->nbits = 0;
+  for (int i = 0; i < a->count; i++) {
+    uint32_t n = quantize(&q, PULSE_TIME(a->pulses[i]));
+    for (uint32_t b = 0; b < n && a->nbits < STREAM_BITS; b++, a->nbits++) {
+      uint8_t mask = 0x80 >> (a->nbits % 8);
+      if (PULSE_LEVEL(a->pulses[i])) {
+        a->bits[a->nbits / 8] |= mask;
+      } else {
+        a->bits[a->nbits / 8] &= ~mask;
+      }
+    }
+  }
+  a->done = true;
+  return true;
+}
+
+// Feeds one pulse, returns true when it ended a message. The message stays
+// in the analyzer until the next pulse.
+static inline bool streamPulse(StreamAnalyzer *a, uint32_t pulse) {
+  uint32_t duration = PULSE_TIME(pulse);
+  uint32_t symbol = streamSymbol(a);
+
+  if (a->done) {
+    a->count = 0;
+    a->done = false;
+  }
+
+  if (!PULSE_LEVEL(pulse) && symbol > 0 && duration > symbol * STREAM_PAUSE) {
+    return streamFinish(a);
+  }
+
+  // Only the class that grew can overtake the best one
+  int s = pulseClassAdd(a->slots, &a->used, duration, a->tolerance, &a->unclustered);
+  if (s >= 0 && a->slots[s].count > a->slots[a->best].count) {
+    a->best = s;
+  }
+
+  a->pulses[a->count++] = pulse;
+  if (a->count == STREAM_PULSES) {
+    return streamFinish(a);
+  }
+  return false;
+}
+
+// Ends the current message when the line went quiet, see streamPulse().
+static inline bool streamIdle(StreamAnalyzer *a) {
+  if (a->done || a->count == 0) {
+    return false;
+  }
+  return streamFinish(a);
+}
+
+// Shortest timing class the message uses in earnest, the base unit for the
+// line code classifier. Classes with less than 1/8 of the pulses are noise.
+static inline uint32_t streamUnit(const StreamAnalyzer *a) {
+  uint32_t unit = 0;
+  uint32_t total = 0;
+
+  for (int s = 0; s < a->used; s++) {
+    total += a->slots[s].count;
+  }
+  for (int s = 0; s < a->used; s++) {
+    const PulseClass *c = &a->slots[s];
+    uint32_t mean = c->sum / c->count;
+    if (c->count * 8 >= total && (unit == 0 || mean < unit)) {
+      unit = mean;
+    }
+  }
+  return unit;
+}
+
+// Line codes, scored on the pulse widths of a message in base units.
+#define LINE_NRZ          0             // every pulse is a run of equal bits
+#define LINE_PWM          1             // constant period, the high width carries the bit
+#define LINE_PPM          2             // constant high, the low width carries the bit
+#define LINE_MANCHESTER   3             // half bit units, low to high is a 1
+#define LINE_BITS         256
+#define LINE_MAX_UNITS    15
+#define LINE_MIN_SCORE    90            // percent of pulses that must fit a structured code
+
+static const char *const lineNames[] = { "NRZ", "PWM", "PPM", "Manchester" };
+
+typedef struct {
+  int code;
+  int score;                            // percent of the message that fits the code
+  uint32_t unit;                        // base unit in us
+  uint8_t bits[LINE_BITS / 8];          // payload, first bit in the top bit
+  int nbits;
+} LineCode;
+
+static inline void linePut(LineCode *l, bool bit) {
+  if (l->nbits == LINE_BITS) {
+    return;
+  }
+  uint8_t mask = 0x80 >> (l->nbits % 8);
+  if (bit) {
+    l->bits[l->nbits / 8] |= mask;
+  } else {
+    l->bits[l->nbits / 8] &= ~mask;
+  }
+  l->nbits++;
+}
+
+// Most frequent value of a histogram over 0..LINE_MAX_UNITS.
+static inline int lineMode(const int *hist) {
+  int mode = 0;
+  for (int u = 1; u <= LINE_MAX_UNITS; u++) {
+    if (hist[u] > hist[mode]) {
+      mode = u;
+    }
+  }
+  return mode;
+}
+
+// Reads Manchester half bits in pairs, skipping the first skip halves. A pair
+// with a low to high transition is a 1. Returns the pairs without one.
+static inline int lineManchester(const uint32_t *p, int n, const SymbolQuantizer *q, int skip, LineCode *out) {
+  int invalid = 0;
+  int halves = 0;
+  bool first = false;
+
+  out->nbits = 0;
+  for (int i = 0; i < n; i++) {
+    bool level = PULSE_LEVEL(p[i]);
+    uint32_t u = quantize(q, PULSE_TIME(p[i]));
+    for (uint32_t h = 0; h < u && h < 2; h++, halves++) {
+      if (halves < skip) {
+        continue;
+      }
+      if ((halves - skip) % 2 == 0) {
+        first = level;
+      } else if (first != level) {
+        linePut(out, level);
+      } else {
+        invalid++;
+      }
+    }
+  }
+  return invalid;
+}
+
+// Classifies a message as PWM, PPM, Manchester or NRZ and decodes its payload.
+// Structured codes need LINE_MIN_SCORE, NRZ is the fallback. Bits are read
+// from high/low pairs starting at the first high pulse.
+static inline void lineDecode(const uint32_t *p, int n, uint32_t unit, LineCode *out) {
+  SymbolQuantizer q;
+  int periods[LINE_MAX_UNITS + 1] = { 0 };
+  int highs[LINE_MAX_UNITS + 1] = { 0 };
+  int lows[LINE_MAX_UNITS + 1] = { 0 };
+  int first = 0;
+  int pairs = 0;
+  int halves = 0;
+  int exact = 0;
+  bool shorthalf = false;
+  bool longhalf = false;
+
+  out->code = LINE_NRZ;
+  out->score = 0;
+  out->unit = unit;
+  out->nbits = 0;
+  if (unit == 0 || n == 0) {
+    return;
+  }
+  quantizerInit(&q, unit);
+
+  // One pass for the unit histograms
+  while (first < n && !PULSE_LEVEL(p[first])) {
+    first++;
+  }
+  for (int i = 0; i < n; i++) {
+    uint32_t t = PULSE_TIME(p[i]);
+    uint32_t u = quantize(&q, t);
+    uint32_t err = t > u * unit ? t - u * unit : u * unit - t;
+    if (err * 4 <= unit) {
+      exact++;
+    }
+    if (u == 1 || u == 2) {
+      halves++;
+      shorthalf |= u == 1;
+      longhalf |= u == 2;
+    }
+    if (i >= first && (i - first) % 2 == 1) {
+      uint32_t h = quantize(&q, PULSE_TIME(p[i - 1]));
+      if (h <= LINE_MAX_UNITS && u <= LINE_MAX_UNITS && h + u <= LINE_MAX_UNITS) {
+        periods[h + u]++;
+        highs[h]++;
+        lows[u]++;
+      }
+      pairs++;
+    }
+  }
+
+  int period = lineMode(periods);
+  int high = lineMode(highs);
+  int pwm = pairs ? periods[period] * 100 / pairs : 0;
+  int ppm = pairs ? highs[high] * 100 / pairs : 0;
+  int manchester = halves * 100 / n;
+
+  // PWM and PPM need two distinct widths in the varying half
+  if (pwm >= LINE_MIN_SCORE && highs[high] < periods[period]) {
+    out->code = LINE_PWM;
+    out->score = pwm;
+  } else if (ppm >= LINE_MIN_SCORE && lows[lineMode(lows)] < pairs) {
+    out->code = LINE_PPM;
+    out->score = ppm;
+  } else if (manchester >= LINE_MIN_SCORE && shorthalf && longhalf) {
+    out->code = LINE_MANCHESTER;
+    out->score = manchester;
+  } else {
+    out->score = exact * 100 / n;
+  }
+
+  // Second pass for the payload
+  if (out->code == LINE_MANCHESTER) {
+    // Half bits pair up from the start or one half later, take the phase
+    // that leaves fewer pairs without a transition
+    LineCode shifted = *out;
+    int invalid = lineManchester(p, n, &q, 0, out);
+    if (invalid && lineManchester(p, n, &q, 1, &shifted) < invalid) {
+      *out = shifted;
+    }
+    return;
+  }
+  int shortlow = LINE_MAX_UNITS;
+  for (int u = 0; u <= LINE_MAX_UNITS; u++) {
+    if (lows[u] && u < shortlow) {
+      shortlow = u;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    uint32_t u = quantize(&q, PULSE_TIME(p[i]));
+    if (out->code == LINE_NRZ) {
+      for (uint32_t b = 0; b < u; b++) {
+        linePut(out, PULSE_LEVEL(p[i]));
+      }
+    } else if (i >= first && (i - first) % 2 == 1) {
+      if (out->code == LINE_PWM) {
+        linePut(out, quantize(&q, PULSE_TIME(p[i - 1])) > u);
+      } else {
+        linePut(out, (int)u > shortlow);
+      }
+    }
+  }
+}
+
+#define TALLY_LINES       8             // different line payloads counted per frame
+
+// Messages per line code payload within one frame, picked like the codes of
+// decoders.h: most repeats, then the longest payload, then the best score.
+typedef struct {
+  LineCode line[TALLY_LINES];
+  int count[TALLY_LINES];
+  int n;
+} LineTally;
+
+static inline void lineTallyReset(LineTally *t) {
+  t->n = 0;
+}
+
+static inline bool lineSame(const LineCode *a, const LineCode *b) {
+  if (a->code != b->code || a->nbits != b->nbits) {
+    return false;
+  }
+  int full = a->nbits / 8;
+  int rest = a->nbits % 8;
+  uint8_t mask = (uint8_t)(0xFF00 >> rest);
+  return memcmp(a->bits, b->bits, full) == 0 && (rest == 0 || ((a->bits[full] ^ b->bits[full]) & mask) == 0);
+}
+
+// Counts one message. A repeat keeps the best score seen for the payload;
+// once the table is full a new payload replaces one seen only once.
+static inline void lineTallyAdd(LineTally *t, const LineCode *l) {
+  if (l->nbits == 0) {
+    return;
+  }
+  for (int i = 0; i < t->n; i++) {
+    if (lineSame(&t->line[i], l)) {
+      t->count[i]++;
+      if (l->score > t->line[i].score) {
+        t->line[i] = *l;
+      }
+      return;
+    }
+  }
+  int at = t->n;
+  if (at == TALLY_LINES) {
+    for (at = TALLY_LINES - 1; at >= 0 && t->count[at] > 1; at--) {
+    }
+    if (at < 0) {
+      return;
+    }
+  } else {
+    t->n++;
+  }
+  t->line[at] = *l;
+  t->count[at] = 1;
+}
+
+// The line code to report and its repeats, NULL when there is none.
+static inline const LineCode *lineTallyBest(const LineTally *t, int *repeats) {
+  int best = -1;
+
+  for (int i = 0; i < t->n; i++) {
+    const LineCode *l = &t->line[i];
+    const LineCode *b = best < 0 ? NULL : &t->line[best];
+    if (b == NULL || t->count[i] > t->count[best] ||
+        (t->count[i] == t->count[best] && (l->nbits > b->nbits || (l->nbits == b->nbits && l->score > b->score)))) {
+      best = i;
+    }
+  }
+  *repeats = best < 0 ? 0 : t->count[best];
+  return best < 0 ? NULL : &t->line[best];
+}
+
+// Writes the payload as hex, the last digit padded with zero bits.
+static inline void lineHex(const LineCode *l, char *out, size_t size) {
+  static const char hex[] = "0123456789ABCDEF";
+  size_t n = 0;
+
+  for (int b = 0; b < l->nbits && n + 1 < size; b += 4) {
+    uint8_t byte = l->bits[b / 8];
+    out[n++] = hex[b % 8 ? byte & 0xF : byte >> 4];
+  }
+  out[n] = 0;
+}
+
+// Majority vote over the repeats of a frame, in symbol level bits.
+#define VOTE_BITS         1024          // longest frame voted on
+#define VOTE_MIN_BITS     8             // shorter pieces between pauses are ignored
+#define VOTE_SHIFT        2             // alignment search, in bits either way
+#define VOTE_MATCH        80            // percent of bits a repeat must agree on
+#define VOTE_MAX_REPEATS  255
+
+typedef struct {
+  uint8_t ones[VOTE_BITS];              // repeats with a 1 at each bit
+  uint8_t votes[VOTE_BITS];             // repeats covering each bit
+  int nbits;
+  int repeats;
+  int rejected;                         // frames that matched no alignment with the majority
+  uint8_t cur[VOTE_BITS / 8];           // frame being read
+  int curbits;
+} FrameVote;
+
+static inline void voteReset(FrameVote *v) {
+  v->nbits = 0;
+  v->repeats = 0;
+  v->rejected = 0;
+  v->curbits = 0;
+}
+
+static inline void voteBit(FrameVote *v, bool bit) {
+  if (v->curbits == VOTE_BITS) {
+    return;
+  }
+  uint8_t mask = 0x80 >> (v->curbits % 8);
+  if (bit) {
+    v->cur[v->curbits / 8] |= mask;
+  } else {
+    v->cur[v->curbits / 8] &= ~mask;
+  }
+  v->curbits++;
+}
+
+static inline bool voteCur(const FrameVote *v, int i) {
+  return v->cur[i / 8] & (0x80 >> (i % 8));
+}
+
+static inline bool voteMajority(const FrameVote *v, int i) {
+  return v->ones[i] * 2 > v->votes[i];
+}
+
+// Percent of all repeats that agree with the majority at bit i.
+static inline int voteConfidence(const FrameVote *v, int i) {
+  int agree = voteMajority(v, i) ? v->ones[i] : v->votes[i] - v->ones[i];
+  return v->repeats ? agree * 100 / v->repeats : 0;
+}
+
+static inline void voteAdd(FrameVote *v, int shift) {
+  int end = v->curbits + shift < VOTE_BITS ? v->curbits + shift : VOTE_BITS;
+
+  for (int k = v->nbits; k < end; k++) {
+    v->ones[k] = 0;
+    v->votes[k] = 0;
+  }
+  if (end > v->nbits) {
+    v->nbits = end;
+  }
+  for (int j = 0; j < v->curbits; j++) {
+    int k = j + shift;
+    if (k >= 0 && k < VOTE_BITS) {
+      v->ones[k] += voteCur(v, j);
+      v->votes[k]++;
+    }
+  }
+  v->repeats++;
+}
+
+// Ends the frame read with voteBit(). It is aligned with the majority and
+// counted as a repeat, or rejected. A single frame that disagrees with the
+// next one is usually a truncated first transmission, so it is replaced
+// without counting either of them as rejected.
+static inline void voteEnd(FrameVote *v) {
+  int best = 0;
+  int bestmatch = -1;
+
+  if (v->curbits < VOTE_MIN_BITS) {
+    v->curbits = 0;
+    return;
+  }
+  if (v->repeats == 0) {
+    v->nbits = 0;
+    voteAdd(v, 0);
+    v->curbits = 0;
+    return;
+  }
+
+  for (int shift = -VOTE_SHIFT; shift <= VOTE_SHIFT; shift++) {
+    int overlap = 0;
+    int match = 0;
+    for (int j = 0; j < v->curbits; j++) {
+      int k = j + shift;
+      if (k >= 0 && k < v->nbits) {
+        overlap++;
+        match += voteCur(v, j) == voteMajority(v, k);
+      }
+    }
+    // Both frames have to be mostly covered by the overlap
+    int longer = v->curbits > v->nbits ? v->curbits : v->nbits;
+    int score = overlap * 8 >= longer * 7 ? match * 100 / overlap : -1;
+    if (score > bestmatch) {
+      bestmatch = score;
+      best = shift;
+    }
+  }
+
+  if (bestmatch >= VOTE_MATCH && v->repeats < VOTE_MAX_REPEATS) {
+    voteAdd(v, best);
+  } else if (bestmatch < VOTE_MATCH && v->repeats == 1) {
+    v->repeats = 0;
+    v->nbits = 0;
+    voteAdd(v, 0);
+  } else if (bestmatch < VOTE_MATCH) {
+    v->rejected++;
+  }
+  v->curbits = 0;
+}
+
+// Length of the voted frame: trailing bits covered by less than half of the
+// repeats are left out.
+static inline int voteLength(const FrameVote *v) {
+  int n = v->nbits;
+  while (n > 0 && v->votes[n - 1] * 2 <= v->repeats) {
+    n--;
+  }
+  return n;
+}
+
+#define FRAME_PAUSE       8             // symbols of low that separate the repeats of a frame
+
+// Called for every repeat of a frame before it is voted, with its bits in
+// vote->cur. frame counts the repeats from 1.
+typedef void (*FrameRepeat)(void *ctx, const FrameVote *vote, int frame);
+
+typedef struct {
+  uint32_t symbol;                      // mean of the most common class, 0 = nothing to analyse
+  int classes;
+  int counted;                          // pulses of at least one symbol, pauses included
+} FrameResult;
+
+// The analysis pass of signalanalyse() over an encoded frame with its
+// lead-in. The symbol time is the mean of the most common class. A first
+// pulse that is the shortest of the frame and shorter than a symbol counts
+// as a whole symbol: it is rewritten in the frame when the new width still
+// fits one word, so the passes that follow see it too. Every pulse is then
+// quantized with q and the repeats, separated by FRAME_PAUSE, are voted.
+static inline void frameAnalyse(uint16_t *words, size_t len, uint32_t tolerance, SymbolQuantizer *q, FrameVote *vote,
+                                FrameRepeat repeat, void *ctx, FrameResult *r) {
+  PulseClasses classes;
+  PulseReader rd;
+  uint32_t pulse;
+  int frame = 0;
+
+  r->symbol = 0;
+  r->classes = 0;
+  r->counted = 0;
+  pulseCluster(words, len, tolerance, &classes);
+  if (classes.count == 0 || classes.classes[0].mean == 0) {
+    return;
+  }
+  r->symbol = classes.classes[0].mean;
+  r->classes = classes.count;
+
+  pulseReaderInit(&rd, words, len);
+  pulseNext(&rd, &pulse);
+  size_t first = rd.pos;
+  if (pulseNext(&rd, &pulse) && PULSE_TIME(pulse) == classes.shortest && classes.shortest < r->symbol) {
+    uint16_t word[PULSE_MAX_WORDS];
+    if (rd.pos == first + 1 && pulseEncode(PULSE(PULSE_LEVEL(pulse), r->symbol), word) == 1) {
+      words[first] = word[0];
+    }
+  }
+
+  quantizerInit(q, r->symbol);
+  voteReset(vote);
+  pulseReaderInit(&rd, words, len);
+  pulseNext(&rd, &pulse);
+  for (;;) {
+    bool more = pulseNext(&rd, &pulse);
+    uint32_t n = more ? quantize(q, PULSE_TIME(pulse)) : 0;
+    bool pause = more && !PULSE_LEVEL(pulse) && n > FRAME_PAUSE;
+    if (!more || pause) {
+      if (vote->curbits) {
+        repeat(ctx, vote, ++frame);
+      }
+      voteEnd(vote);
+    }
+    if (!more) {
+      break;
+    }
+    if (n > 0) {
+      r->counted++;
+    }
+    if (!pause) {
+      for (uint32_t b = 0; b < n; b++) {
+        voteBit(vote, PULSE_LEVEL(pulse));
+      }
+    }
+  }
+}
+
+// Receive filter bandwidths of the CC1101 in kHz, 26 MHz crystal. 203.125 is
+// rounded down, setRxBW() takes 203.13 for the next wider filter.
+static const float rxBandwidths[] = {
+  58.04, 67.71, 81.25, 101.56, 116.07, 135.42, 162.50, 203.12,
+  232.14, 270.83, 325.00, 406.25, 464.29, 541.67, 650.00, 812.50
+};
+
+#define RXBW_COUNT        (sizeof(rxBandwidths) / sizeof(rxBandwidths[0]))
+#define RXBW_CRYSTAL_PPM  20            // worst case error of either crystal
+#define RXBW_OOK_LOBES    4             // spectrum kept around an OOK carrier, in symbol rates
+
+// Receive filter the CC1101 driver sets for a bandwidth in kHz, as the
+// CHANBW_E and CHANBW_M bits of MDMCFG4 (0 = widest). setRxBW() rounds any
+// value to one of the 16 filters, so bandwidths are compared by this.
+static inline int bandwidthStep(float khz) {
+  int e = 3;
+  int m = 3;
+
+  for (int i = 0; i < 3 && khz > 101.5625f; i++) {
+    khz /= 2;
+    e--;
+  }
+  for (int i = 0; i < 3 && khz > 58.1f; i++) {
+    khz /= 1.25f;
+    m--;
+  }
+  return e * 4 + m;
+}
+
+// Symbol rate in kBaud for a symbol time in us.
+static inline float rateEstimate(uint32_t symbol) {
+  return symbol ? 1000.0f / symbol : 0;
+}
+
+// Narrowest filter that passes the signal and the carrier offset two crystals
+// can add up to. FSK needs twice the deviation plus the symbol rate (Carson),
+// OOK keeps a few lobes so pulse edges are not smeared.
+static inline float bandwidthEstimate(float kbaud, int mod, float deviation, float mhz) {
+  float need = mod == 2 ? kbaud * RXBW_OOK_LOBES : 2 * deviation + kbaud;
+  need += 4 * RXBW_CRYSTAL_PPM * mhz / 1000;
+  for (size_t i = 0; i < RXBW_COUNT; i++) {
+    if (rxBandwidths[i] >= need) {
+      return rxBandwidths[i];
+    }
+  }
+  return rxBandwidths[RXBW_COUNT - 1];
+}
+
+#define FREQEST_KHZ       1.5869f       // kHz per FREQEST step, 26 MHz / 2^14
+
+// FREQEST readings taken while a frame arrives, see rxFskEstimate() in
+// firmware.ino. The histogram keeps the shape of the readings for the
+// percentiles: when a bin is full all bins are halved, so long captures do
+// not flatten the peaks. samples and sum count every reading for the mean.
+typedef struct {
+  uint8_t hist[256];                    // readings per value, index = FREQEST + 128
+  int samples;
+  int32_t sum;
+} FreqSamples;
+
+static inline void freqReset(FreqSamples *f) {
+  memset(f->hist, 0, sizeof(f->hist));
+  f->samples = 0;
+  f->sum = 0;
+}
+
+static inline void freqAdd(FreqSamples *f, int8_t est) {
+  uint8_t *bin = &f->hist[est + 128];
+  if (*bin == 255) {
+    for (int i = 0; i < 256; i++) {
+      f->hist[i] /= 2;
+    }
+  }
+  (*bin)++;
+  f->samples++;
+  f->sum += est;
+}
+
+// FREQEST value below which pct percent of the readings lie.
+static inline int freqPercentile(const FreqSamples *f, int pct) {
+  int total = 0;
+  int seen = 0;
+
+  for (int i = 0; i < 256; i++) {
+    total += f->hist[i];
+  }
+  for (int i = 0; i < 256; i++) {
+    seen += f->hist[i];
+    if (seen * 100 >= total * pct) {
+      return i - 128;
+    }
+  }
+  return 127;
+}
+
+#endif
@@ -0,0 +1,232 @@
+/*
+  capture.h - Capture state of the CC1101 modules
+
+  Edges reach the RF task through the ring of edgering.h, from the GPIO
+  CHANGE interrupt or from the RMT peripheral (RX_BACKEND_RMT in
+  firmware.ino), and are assembled into frames with framer.h. This file
+  holds the per module state the RF task builds frames in, and the records
+  kept for /messages and /captures.
+*/
+#ifndef CAPTURE_h
+#define CAPTURE_h
+
+#include <Arduino.h>
+#include "pulses.h"
+#include "edgering.h"
+#include "framer.h"
+#include "analyzer.h"
+#include "decoders.h"
+#include "correlator.h"
+
+#define samplewords       4000          // words per frame, about as many pulses
+#define FRAME_GAP         100000        // default us of silence that separates frames
+#define HISTORY_SIZE      512           // pre-trigger pulses kept per module, power of two
+
+// Capture triggers. Until one fires, pulses only go to the history ring.
+#define TRIGGER_GAP       0             // first pulse after framegap of silence
+#define TRIGGER_RSSI      1             // RSSI at or above triggerrssi
+#define TRIGGER_DENSITY   2             // triggercount edges within triggerwindow
+#define TRIGGER_PATTERN   3             // triggercount pulses of the same width in a row
+
+// FSK estimate, see rxFskEstimate()
+#define FSK_ESTIMATE_OFF       0
+#define FSK_ESTIMATE_OFFSET    1        // retune the frequency, only log the deviation
+#define FSK_ESTIMATE_DEVIATION 2        // retune the deviation too
+
+#define MESSAGE_CHARS     256           // bits of a message shown by /messages
+
+#define FRAME_IDLE        0             // waiting for a trigger
+#define FRAME_CAPTURE     1             // pulses go to the frame
+
+// Last message found by the stream analyzer of a module.
+typedef struct {
+  unsigned long time;                 // millis() when it ended
+  uint32_t symbol;
+  int nbits;
+  char bits[MESSAGE_CHARS + 1];
+  Decoded decoded;                    // protocol is NULL when no decoder matched
+  LineCode line;
+} RxMessage;
+
+#define CAPTURE_RECORDS   64          // captures kept for /captures
+#define CAPTURE_PAGE      16          // records per /captures response without limit
+#define CAPTURE_JSON      768         // longest record as JSON
+
+// Summary of one capture for /captures. Records are numbered from 1 in the
+// order the captures ended, on both modules.
+typedef struct {
+  uint32_t id;
+  unsigned long time;                 // millis() when the capture ended
+  int module;
+  int mod;
+  float frequency;
+  float setrxbw;
+  float datarate;
+  float deviation;
+  int rssi;                           // peak dBm
+  uint32_t pulses;                    // without the lead-in
+  uint32_t duration;                  // us, sum of the pulses
+  uint32_t shortest;
+  uint32_t longest;
+  int symbol;                         // shortest symbol in us, 0 when not analysed
+  uint32_t messages;                  // messages found while the capture arrived
+  int frames;                         // repeats lined up by the vote
+  Decoded decoded;
+  int repeats;                        // messages with the decoded code
+  LineCode line;
+} CaptureRecord;
+
+// A /captures response being sent. The records are formatted one at a time
+// as the connection takes them, text holds the piece not yet sent.
+typedef struct {
+  uint32_t since;                     // cursor the client gave
+  uint32_t from;                      // first and last record of the page
+  uint32_t to;
+  uint32_t id;                        // next record to format
+  uint32_t newest;
+  unsigned long now;                  // millis() of the request, for the ages
+  bool done;                          // the tail is formatted
+  char text[CAPTURE_JSON];
+  size_t len;
+  size_t pos;
+} CaptureCursor;
+
+// Receive settings of one module, as sent with /setrx. They are handed to the
+// RF task as a whole so a module is never running with half of them applied.
+typedef struct {
+  int mod;
+  float frequency;
+  float setrxbw;
+  float deviation;
+  float datarate;                     // kBaud
+  int error_toleranz;
+  int minsample;
+
+  // Filter and noise gate
+  uint32_t minpulsebase;              // configured threshold, adaptive floor
+  bool adaptive;                      // learn minpulse from runt statistics
+  int rssigate;                       // dB above the noise floor a frame must reach, 0 = off
+  uint32_t framegap;                  // us of silence that ends a frame
+
+  // Carrier sense on GDO0
+  bool carriersense;                  // frames are bounded by the CS output
+  int csthreshold;                    // dB relative to the AGC target
+  uint32_t cshold;                    // us without carrier that ends a frame, 0 = by modulation
+
+  // Trigger
+  int trigger;
+  int pretrigger;                     // history pulses committed in front of the trigger
+  int posttrigger;                    // pulses after the trigger, 0 = until silence
+  int triggerrssi;                    // dBm
+  int triggercount;
+  uint32_t triggerwindow;             // us
+
+  // Patterns searched in the bits of every frame, len 0 = off
+  BitPattern preamble;
+  BitPattern sync;
+  int syncerrors;                     // bits either pattern may differ in
+
+  bool autotune;                      // retune datarate and setrxbw from the symbol time
+  int fskestimate;                    // FSK_ESTIMATE_*, 2-FSK only
+  bool ecap;                          // also store captures in captures.ecap
+} RxConfig;
+
+#define SYNC_HITS 32                  // preamble or sync matches logged per capture
+
+// Pattern matches in the frames of a capture, see signalanalyse().
+typedef struct {
+  int count;                          // may exceed SYNC_HITS, only the first are kept
+  int frame[SYNC_HITS];
+  BitMatch match[SYNC_HITS];
+} SyncHits;
+
+// Matches of both patterns over the frames of a capture.
+typedef struct {
+  const RxConfig *cfg;
+  SyncHits preambles;
+  SyncHits syncs;
+} FrameHits;
+
+// Closed loop data rate and filter tuning, see rxAutotune().
+typedef struct {
+  uint32_t symbol;                    // smoothed symbol time in us, 0 = no capture yet
+  int stable;                         // captures in a row close to the smoothed time
+  int retunes;
+} RxTune;
+
+// Capture state of one CC1101 module. Each module has its own ISR argument,
+// timebase, ring, frame buffer and thresholds so both can receive at once.
+typedef struct {
+  byte module;                        // 0 = module 1, 1 = module 2
+  int rxpin;
+  volatile bool active;
+  volatile unsigned long lastTime;
+  portMUX_TYPE lock;                  // guards filter between ISR and captureFlush()
+  GlitchFilter filter;
+  EdgeRing ring;
+  RxConfig cfg;
+
+  // Filter and noise gate
+  volatile uint32_t minpulse;         // current runt threshold in us
+  uint32_t framegap;                  // us of silence that ends a frame, read by the ISR
+  int noisefloor;                     // idle RSSI average in dBm
+  int peakrssi;                       // highest RSSI seen in the current frame
+  unsigned long rssitime;
+  unsigned long adapttime;
+  uint32_t lastruns;
+  uint32_t lastruntsum;
+  uint32_t gated;                     // frames rejected by the noise gate
+  int symbol;                         // shortest symbol of the last frame in us
+
+  // Carrier sense on GDO0
+  int cspin;
+  uint32_t cshold;                    // us without carrier that ends a frame
+  volatile bool carrier;
+  volatile bool csstart;              // carrier came up after a hold time without it
+  volatile bool csseen;               // carrier was up during the current frame
+  volatile unsigned long csdrop;      // when the carrier went away
+
+  // End of frame to RF task latency, see /stats
+  volatile unsigned long notifytime;  // last wake up sent by an interrupt
+  unsigned long frameend;             // when the frame completed
+  uint32_t latencymax;
+  uint32_t latencysum;
+  uint32_t latencycount;
+
+  // RMT backend, see rmtPollReceive()
+  uint32_t rmtoverflows;              // blocks cut short by a full channel memory
+  uint32_t rmtrearm;                  // longest us from a completed block to the next receive
+
+  // Pre-trigger history
+  uint32_t history[HISTORY_SIZE];
+  uint32_t histhead;                  // total pulses pushed, newest at histhead - 1
+  uint32_t histsum;                   // duration of the last triggercount pulses
+  int histrun;                        // same width pulses in a row
+  uint32_t held;                      // popped pulse that starts the next frame
+  int framestate;
+  bool framefull;
+  int postcount;
+
+  // Messages decoded while the frame is arriving, see /messages
+  StreamAnalyzer stream;
+  portMUX_TYPE msglock;               // guards message between RF task and web server
+  RxMessage message;
+  uint32_t messages;
+  uint32_t framestart;                // messages before the current frame
+  CodeTally codes;                    // messages per decoded code of the current frame
+  LineTally lines;                    // messages per line code payload
+  Decoded decoded;                    // code received most often in the frame
+  int repeats;                        // messages of the frame with that code
+  LineCode line;                      // line code received most often, nbits 0 = none
+  FrameVote vote;                     // repeats of the last analysed frame, see signalanalyse()
+  RxTune tune;
+  FreqSamples freq;
+  float freqoffset;                   // last FSK estimates in kHz
+  float fskdeviation;
+
+  uint16_t sample[samplewords];       // encoded pulses, see pulses.h
+  size_t samplelen;                   // words used in sample
+  int samplecount;                    // pulses in sample
+} RxContext;
+
+#endif
@@ -0,0 +1,128 @@
+/*
+  correlator.h - Preamble and sync word search in packed bits
+
+  Bits are packed first bit in the top bit of the first byte, as the stream
+  analyzer and FrameVote in analyzer.h keep them. The search reads the bits
+  a 64 bit word at a time and takes the window at each position from two
+  neighbouring words; a position costs two shifts, one XOR with the pattern
+  and one popcount, whatever the pattern length.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef CORRELATOR_h
+#define CORRELATOR_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PATTERN_BITS      64            // longest preamble or sync word
+
+typedef struct {
+  uint64_t bits;                        // first bit in bit len - 1
+  int len;                              // 0 = no pattern
+} BitPattern;
+
+typedef struct {
+  int offset;                           // bit where the pattern starts
+  int errors;                           // bits that differ
+} BitMatch;
+
+// Reads a pattern of '0' and '1', or hex digits after "0x". Returns false
+// for anything else or more than PATTERN_BITS bits; an empty text clears it.
+static inline bool patternParse(const char *text, BitPattern *p) {
+  bool hex = text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+  uint64_t bits = 0;
+  int len = 0;
+
+  for (const char *c = hex ? text + 2 : text; *c; c++) {
+    int v;
+    int width = hex ? 4 : 1;
+    if (!hex && (*c == '0' || *c == '1')) {
+      v = *c - '0';
+    } else if (hex && *c >= '0' && *c <= '9') {
+      v = *c - '0';
+    } else if (hex && (*c | 0x20) >= 'a' && (*c | 0x20) <= 'f') {
+      v = (*c | 0x20) - 'a' + 10;
+    } else {
+      return false;
+    }
+    if (len + width > PATTERN_BITS) {
+      return false;
+    }
+    bits = bits << width | v;
+    len += width;
+  }
+  p->bits = bits;
+  p->len = len;
+  return true;
+}
+
+static inline int patternPopcount(uint64_t v) {
+  return __builtin_popcountll(v);
+}
+
+// 64 bits from byte 8 * w on, first bit in the top bit, zero past nbytes.
+static inline uint64_t patternWord(const uint8_t *bits, int nbytes, int w) {
+  uint64_t v = 0;
+  for (int i = w * 8; i < w * 8 + 8; i++) {
+    v = v << 8 | (i < nbytes ? bits[i] : 0);
+  }
+  return v;
+}
+
+// Finds up to max positions where the pattern matches with at most maxerrors
+// differing bits, searching from bit from. Of matches that overlap, the one
+// with the fewest errors is reported. Returns the number of matches.
+static inline int patternSearch(const uint8_t *bits, int nbits, int from, const BitPattern *p,
+                                int maxerrors, BitMatch *out, int max) {
+  // Pattern and mask in the top bits, like the window
+  uint64_t mask = p->len == 64 ? ~0ULL : ~(~0ULL >> p->len);
+  uint64_t pattern = p->len == 64 ? p->bits : p->bits << (64 - p->len);
+  int nbytes = (nbits + 7) / 8;
+  int last = nbits - p->len;            // last offset the whole pattern fits at
+  BitMatch best = { 0, 0 };
+  bool have = false;
+  int found = 0;
+
+  if (p->len == 0 || from < 0 || max <= 0) {
+    return 0;
+  }
+  for (int w = from / 64; w * 64 <= last; w++) {
+    uint64_t hi = patternWord(bits, nbytes, w);
+    uint64_t lo = patternWord(bits, nbytes, w + 1);
+    int start = w * 64 < from ? from - w * 64 : 0;
+    int end = last - w * 64 < 63 ? last - w * 64 : 63;
+    for (int s = start; s <= end; s++) {
+      uint64_t window = s ? hi << s | lo >> (64 - s) : hi;
+      int offset = w * 64 + s;
+      if (have && offset >= best.offset + p->len) {
+        out[found++] = best;
+        have = false;
+        if (found == max) {
+          return found;
+        }
+      }
+      int errors = patternPopcount((window ^ pattern) & mask);
+      if (errors <= maxerrors && (!have || errors < best.errors)) {
+        best.offset = offset;
+        best.errors = errors;
+        have = true;
+      }
+    }
+  }
+  if (have) {
+    out[found++] = best;
+  }
+  return found;
+}
+
+// Writes the pattern as '0' and '1'.
+static inline void patternText(const BitPattern *p, char *out, size_t size) {
+  size_t n = 0;
+  for (int b = p->len - 1; b >= 0 && n + 1 < size; b--) {
+    out[n++] = (p->bits >> b) & 1 ? '1' : '0';
+  }
+  out[n] = 0;
+}
+
+#endif
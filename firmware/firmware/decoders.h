@@ -0,0 +1,254 @@
+/*
+  decoders.h - Fixed code remote decoders
+
+  Every protocol is one row of the protocols[] table: the accepted range of
+  the base pulse (te), the high/low shape of a 0 and a 1 bit in te, and the
+  start and stop pulses around the data. A single state machine,
+  protocolDecode(), reads a message with any row, so adding a family is a
+  table entry rather than another decode loop.
+
+  A message is the pulse train between two pauses, as the stream analyzer
+  in analyzer.h hands it over: the pause before it is not included and the
+  end of the message stands for the pause after it.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef DECODERS_h
+#define DECODERS_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "pulses.h"
+
+#define PROTO_LOW_FIRST   0x01          // a bit is low then high, after a high start pulse
+#define PROTO_TRISTATE    0x02          // bit pairs 00, 11 and 01 are the trits 0, 1 and F
+
+#define PROTO_FRACTION    16U           // pair split resolution, in 1/16 of a te
+#define PROTO_SLACK       6U            // allowed split error, in 1/16 of a te
+
+typedef struct {
+  const char *name;
+  uint16_t temin;                       // accepted base pulse range in us
+  uint16_t temax;
+  uint8_t zero[2];                      // first and second pulse of a 0 bit in te
+  uint8_t one[2];                       // first and second pulse of a 1 bit in te
+  uint8_t start;                        // high pulse in te before the data, 0 = none
+  uint8_t stop;                         // high pulse in te after the data, 0 = none
+  uint8_t gap;                          // low of at least this many te ends the data
+  uint8_t minbits;
+  uint8_t maxbits;                      // at most 32
+  uint8_t flags;
+} Protocol;
+
+// Tried in order, the first row that decodes a message wins
+static const Protocol protocols[] = {
+  // name        temin temax zero    one     start stop gap minbits maxbits flags
+  { "PT2262",    100,  700,  {1, 3}, {3, 1}, 0,    1,   8,  24,     24,     PROTO_TRISTATE },
+  { "EV1527",    100,  700,  {1, 3}, {3, 1}, 0,    1,   8,  24,     24,     0 },
+  { "Princeton", 100,  700,  {1, 3}, {3, 1}, 0,    1,   8,  12,     32,     0 },
+  { "CAME",      250,  450,  {1, 2}, {2, 1}, 1,    0,   4,  12,     24,     PROTO_LOW_FIRST },
+  { "Nice FLO",  550,  850,  {1, 2}, {2, 1}, 1,    0,   4,  12,     24,     PROTO_LOW_FIRST },
+};
+
+#define PROTOCOL_COUNT (sizeof(protocols) / sizeof(protocols[0]))
+
+typedef struct {
+  const Protocol *protocol;             // NULL when nothing decoded
+  uint32_t code;                        // first bit received in the top bit
+  int bits;
+  uint32_t te;                          // measured base pulse in us
+} Decoded;
+
+// Returns the bit a pulse pair stands for, or -1 when it matches neither.
+static inline int protocolBit(const Protocol *pr, uint32_t first, uint32_t second) {
+  uint32_t units = pr->zero[0] + pr->zero[1];
+  uint32_t split = first * units * PROTO_FRACTION / (first + second);
+
+  if (split + PROTO_SLACK >= pr->zero[0] * PROTO_FRACTION && split <= pr->zero[0] * PROTO_FRACTION + PROTO_SLACK) {
+    return 0;
+  }
+  if (split + PROTO_SLACK >= pr->one[0] * PROTO_FRACTION && split <= pr->one[0] * PROTO_FRACTION + PROTO_SLACK) {
+    return 1;
+  }
+  return -1;
+}
+
+static inline bool protocolNear(uint32_t duration, uint32_t units, uint32_t te) {
+  uint32_t expect = units * te;
+  uint32_t diff = duration > expect ? duration - expect : expect - duration;
+  return diff <= te / 2;
+}
+
+// Decodes one message with one protocol.
+static inline bool protocolDecode(const Protocol *pr, const uint32_t *p, int n, Decoded *out) {
+  bool lowfirst = pr->flags & PROTO_LOW_FIRST;
+  uint32_t units = pr->zero[0] + pr->zero[1];
+  uint32_t te0 = 0;
+  uint32_t total = 0;
+  uint32_t code = 0;
+  int bits = 0;
+  int k = 0;
+
+  if (pr->start) {
+    if (n == 0 || !PULSE_LEVEL(p[0])) {
+      return false;
+    }
+    k = 1;
+  }
+
+  while (k + 1 < n) {
+    uint32_t first = PULSE_TIME(p[k]);
+    uint32_t second = PULSE_TIME(p[k + 1]);
+
+    if (PULSE_LEVEL(p[k]) == lowfirst) {
+      return false;
+    }
+    // A long low ends the data, for high first bits it follows the stop pulse
+    if (te0 && lowfirst && first >= pr->gap * te0) {
+      break;
+    }
+    if (te0 && !lowfirst && second >= pr->gap * te0) {
+      break;
+    }
+
+    int bit = protocolBit(pr, first, second);
+    uint32_t te = (first + second) / units;
+    if (bit < 0 || bits == pr->maxbits) {
+      return false;
+    }
+    if (te0 == 0) {
+      te0 = te;
+    } else if (te * 10 < te0 * 7 || te * 10 > te0 * 13) {
+      return false;
+    }
+    code = code << 1 | bit;
+    total += first + second;
+    bits++;
+    k += 2;
+  }
+
+  if (bits < pr->minbits) {
+    return false;
+  }
+
+  uint32_t te = total / (units * bits);
+  if (te < pr->temin || te > pr->temax) {
+    return false;
+  }
+  if (pr->start && !protocolNear(PULSE_TIME(p[0]), pr->start, te)) {
+    return false;
+  }
+  if (pr->stop && (k >= n || !PULSE_LEVEL(p[k]) || !protocolNear(PULSE_TIME(p[k]), pr->stop, te))) {
+    return false;
+  }
+  if (pr->flags & PROTO_TRISTATE) {
+    if (bits % 2) {
+      return false;
+    }
+    for (int b = 0; b < bits; b += 2) {
+      if (((code >> (bits - 2 - b)) & 3) == 2) {
+        return false;
+      }
+    }
+  }
+
+  out->protocol = pr;
+  out->code = code;
+  out->bits = bits;
+  out->te = te;
+  return true;
+}
+
+// Runs a message through the protocol table.
+static inline bool decodeMessage(const uint32_t *p, int n, Decoded *out) {
+  out->protocol = NULL;
+  for (size_t i = 0; i < PROTOCOL_COUNT; i++) {
+    if (protocolDecode(&protocols[i], p, n, out)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#define TALLY_CODES       8             // different codes counted per frame
+
+// Messages per decoded code within one frame. The code received most often
+// is reported, the longer code when two are received equally often.
+typedef struct {
+  Decoded code[TALLY_CODES];
+  int count[TALLY_CODES];
+  int n;
+} CodeTally;
+
+static inline void codeTallyReset(CodeTally *t) {
+  t->n = 0;
+}
+
+// Counts one decoded message. Once the table is full a new code takes the
+// place of one received only once, so a burst of noise cannot push out the
+// code that repeats.
+static inline void codeTallyAdd(CodeTally *t, const Decoded *d) {
+  for (int i = 0; i < t->n; i++) {
+    if (t->code[i].protocol == d->protocol && t->code[i].code == d->code && t->code[i].bits == d->bits) {
+      t->count[i]++;
+      return;
+    }
+  }
+  int at = t->n;
+  if (at == TALLY_CODES) {
+    for (at = TALLY_CODES - 1; at >= 0 && t->count[at] > 1; at--) {
+    }
+    if (at < 0) {
+      return;
+    }
+  } else {
+    t->n++;
+  }
+  t->code[at] = *d;
+  t->count[at] = 1;
+}
+
+// The code to report and its repeats, NULL when nothing was decoded.
+static inline const Decoded *codeTallyBest(const CodeTally *t, int *repeats) {
+  int best = -1;
+
+  for (int i = 0; i < t->n; i++) {
+    if (best < 0 || t->count[i] > t->count[best] ||
+        (t->count[i] == t->count[best] && t->code[i].bits > t->code[best].bits)) {
+      best = i;
+    }
+  }
+  *repeats = best < 0 ? 0 : t->count[best];
+  return best < 0 ? NULL : &t->code[best];
+}
+
+// Looks a protocol up by name, NULL when there is none.
+static inline const Protocol *protocolFind(const char *name) {
+  for (size_t i = 0; i < PROTOCOL_COUNT; i++) {
+    if (strcmp(protocols[i].name, name) == 0) {
+      return &protocols[i];
+    }
+  }
+  return NULL;
+}
+
+// Writes the code as text: trits for tri-state protocols, hex otherwise.
+static inline void decodedCode(const Decoded *d, char *out, size_t size) {
+  static const char hex[] = "0123456789ABCDEF";
+  size_t n = 0;
+
+  if (d->protocol->flags & PROTO_TRISTATE) {
+    for (int b = 0; b < d->bits && n + 1 < size; b += 2) {
+      uint32_t trit = (d->code >> (d->bits - 2 - b)) & 3;
+      out[n++] = trit == 0 ? '0' : trit == 3 ? '1' : 'F';
+    }
+  } else {
+    for (int b = (d->bits + 3) / 4 - 1; b >= 0 && n + 1 < size; b--) {
+      out[n++] = hex[(d->code >> (b * 4)) & 0xF];
+    }
+  }
+  out[n] = 0;
+}
+
+#endif
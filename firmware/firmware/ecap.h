@@ -0,0 +1,285 @@
+/*
+  ecap.h - Binary capture container
+
+  An .ecap file is a file header followed by one record per capture:
+
+    file header   16 bytes: "ECAP", version, flags, reserved
+    record        "ECFR", body size, body, CRC-32 of the body
+      body        EcapMeta (32 bytes), body size - 88 bytes of pulse words
+                  in the encoding of pulses.h, EcapDecoded (56 bytes)
+    index         optional: u32 offset of every record, then the footer
+    footer        16 bytes: "ECIX", record count, index offset, CRC-32 of
+                  the offsets
+
+  The device only appends records and keeps their offsets in a file of its
+  own next to the capture file, captures.idx, u32 each; files written by
+  the host converter end with the index, so a reader can seek to record N
+  directly. Without either, records are found by hopping from one record
+  header to the next, which reads 40 bytes per record, and ecapNext()
+  searches on from a damaged one. All numbers are little endian.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef ECAP_h
+#define ECAP_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ECAP_MAGIC        0x50414345UL  // "ECAP"
+#define ECAP_RECORD_MAGIC 0x52464345UL  // "ECFR"
+#define ECAP_INDEX_MAGIC  0x58494345UL  // "ECIX"
+#define ECAP_VERSION      1
+
+#define ECAP_HEADER_SIZE  16
+#define ECAP_RECORD_SIZE  8             // record header: magic, body size
+#define ECAP_CRC_SIZE     4
+#define ECAP_META_SIZE    32
+#define ECAP_DECODED_SIZE 56
+#define ECAP_FOOTER_SIZE  16
+#define ECAP_NAME_SIZE    12            // protocol name, NUL padded
+#define ECAP_PAYLOAD_SIZE 32            // line code payload bytes, LINE_BITS / 8
+#define ECAP_NO_LINE      0xFF          // linecode when no line code was found
+#define ECAP_SCAN         256           // bytes read at a time when searching for a record
+
+// Size of a whole record with the given number of pulse words.
+#define ECAP_RECORD_BYTES(words) \
+  (ECAP_RECORD_SIZE + ECAP_META_SIZE + (words) * 2 + ECAP_DECODED_SIZE + ECAP_CRC_SIZE)
+
+// Capture metadata at the start of a record body.
+typedef struct {
+  uint32_t time;                        // ms since boot when the capture ended
+  uint8_t module;                       // 0 = module 1
+  uint8_t mod;                          // modulation as in /setrx
+  int8_t rssi;                          // peak dBm
+  uint8_t flags;                        // reserved, 0
+  uint32_t frequency;                   // Hz
+  uint32_t rxbw;                        // Hz
+  uint32_t datarate;                    // Baud
+  uint32_t symbol;                      // us, 0 when not analysed
+  uint32_t pulses;                      // pulses in the words, lead-in included
+  uint32_t words;                       // encoded pulse words that follow
+} EcapMeta;
+
+// Analysis results at the end of a record body.
+typedef struct {
+  char protocol[ECAP_NAME_SIZE];        // empty when no decoder matched
+  uint32_t code;
+  uint8_t bits;
+  uint8_t linecode;                     // LINE_* of analyzer.h or ECAP_NO_LINE
+  uint16_t te;
+  uint16_t linebits;
+  uint8_t payload[ECAP_PAYLOAD_SIZE];
+} EcapDecoded;
+
+static inline void ecapPut16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void ecapPut32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline uint16_t ecapGet16(const uint8_t *p) {
+  return p[0] | p[1] << 8;
+}
+
+static inline uint32_t ecapGet32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// CRC-32 (IEEE 802.3) with a 16 entry table. Start with crc = 0.
+static inline uint32_t ecapCrc(uint32_t crc, const void *data, size_t len) {
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  const uint8_t *p = (const uint8_t *)data;
+
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ table[crc & 15];
+    crc = (crc >> 4) ^ table[crc & 15];
+  }
+  return ~crc;
+}
+
+static inline void ecapHeader(uint8_t *out) {
+  memset(out, 0, ECAP_HEADER_SIZE);
+  ecapPut32(out, ECAP_MAGIC);
+  ecapPut16(out + 4, ECAP_VERSION);
+}
+
+static inline bool ecapCheckHeader(const uint8_t *in) {
+  return ecapGet32(in) == ECAP_MAGIC && ecapGet16(in + 4) == ECAP_VERSION;
+}
+
+static inline void ecapRecordHeader(uint8_t *out, uint32_t words) {
+  ecapPut32(out, ECAP_RECORD_MAGIC);
+  ecapPut32(out + 4, ECAP_META_SIZE + words * 2 + ECAP_DECODED_SIZE);
+}
+
+// Returns the body size of the record starting at in, 0 when it is none.
+static inline uint32_t ecapRecordBody(const uint8_t *in) {
+  uint32_t size = ecapGet32(in + 4);
+  if (ecapGet32(in) != ECAP_RECORD_MAGIC || size < ECAP_META_SIZE + ECAP_DECODED_SIZE) {
+    return 0;
+  }
+  return size;
+}
+
+static inline void ecapMetaPut(uint8_t *out, const EcapMeta *m) {
+  ecapPut32(out, m->time);
+  out[4] = m->module;
+  out[5] = m->mod;
+  out[6] = (uint8_t)m->rssi;
+  out[7] = m->flags;
+  ecapPut32(out + 8, m->frequency);
+  ecapPut32(out + 12, m->rxbw);
+  ecapPut32(out + 16, m->datarate);
+  ecapPut32(out + 20, m->symbol);
+  ecapPut32(out + 24, m->pulses);
+  ecapPut32(out + 28, m->words);
+}
+
+static inline void ecapMetaGet(const uint8_t *in, EcapMeta *m) {
+  m->time = ecapGet32(in);
+  m->module = in[4];
+  m->mod = in[5];
+  m->rssi = (int8_t)in[6];
+  m->flags = in[7];
+  m->frequency = ecapGet32(in + 8);
+  m->rxbw = ecapGet32(in + 12);
+  m->datarate = ecapGet32(in + 16);
+  m->symbol = ecapGet32(in + 20);
+  m->pulses = ecapGet32(in + 24);
+  m->words = ecapGet32(in + 28);
+}
+
+static inline void ecapDecodedPut(uint8_t *out, const EcapDecoded *d) {
+  memcpy(out, d->protocol, ECAP_NAME_SIZE);
+  ecapPut32(out + 12, d->code);
+  out[16] = d->bits;
+  out[17] = d->linecode;
+  ecapPut16(out + 18, d->te);
+  ecapPut16(out + 20, d->linebits);
+  memcpy(out + 22, d->payload, ECAP_PAYLOAD_SIZE);
+  out[54] = 0;
+  out[55] = 0;
+}
+
+static inline void ecapDecodedGet(const uint8_t *in, EcapDecoded *d) {
+  memcpy(d->protocol, in, ECAP_NAME_SIZE);
+  d->protocol[ECAP_NAME_SIZE - 1] = 0;
+  d->code = ecapGet32(in + 12);
+  d->bits = in[16];
+  d->linecode = in[17];
+  d->te = ecapGet16(in + 18);
+  d->linebits = ecapGet16(in + 20);
+  memcpy(d->payload, in + 22, ECAP_PAYLOAD_SIZE);
+}
+
+// Writes a whole record to out, ECAP_RECORD_BYTES(m->words) long, and
+// returns its size.
+static inline size_t ecapRecordPut(uint8_t *out, const EcapMeta *m, const uint16_t *words, const EcapDecoded *d) {
+  uint8_t *b = out + ECAP_RECORD_SIZE;
+  uint32_t body = ECAP_META_SIZE + m->words * 2 + ECAP_DECODED_SIZE;
+
+  ecapRecordHeader(out, m->words);
+  ecapMetaPut(b, m);
+  for (uint32_t i = 0; i < m->words; i++) {
+    ecapPut16(b + ECAP_META_SIZE + i * 2, words[i]);
+  }
+  ecapDecodedPut(b + body - ECAP_DECODED_SIZE, d);
+  ecapPut32(b + body, ecapCrc(0, b, body));
+  return ECAP_RECORD_SIZE + body + ECAP_CRC_SIZE;
+}
+
+// Size of the record whose header and metadata are in head, when it fits
+// between pos and the end of a file of size bytes, else 0. The body size
+// has to agree with the number of words, so a stray "ECFR" in the pulses
+// rarely passes.
+static inline uint32_t ecapRecordAt(const uint8_t *head, uint32_t pos, uint32_t size) {
+  uint32_t body = ecapRecordBody(head);
+  if (body == 0 || body != ECAP_META_SIZE + ecapGet32(head + ECAP_RECORD_SIZE + 28) * 2 + ECAP_DECODED_SIZE ||
+      pos > size || size - pos < ECAP_RECORD_SIZE + body + ECAP_CRC_SIZE) {
+    return 0;
+  }
+  return ECAP_RECORD_SIZE + body + ECAP_CRC_SIZE;
+}
+
+// Reads len bytes at pos, false when there are not that many.
+typedef bool (*EcapRead)(void *ctx, uint32_t pos, uint8_t *buf, size_t len);
+
+// Whether the record of len bytes at pos is whole: the next record or the
+// end of the file follows it or, failing that, its CRC checks out. A record
+// cut short keeps its header, this keeps it from hiding the next one.
+static inline bool ecapRecordWhole(EcapRead read, void *ctx, uint32_t pos, uint32_t len, uint32_t size) {
+  uint8_t buf[ECAP_RECORD_SIZE + ECAP_META_SIZE];
+  uint32_t crc = 0;
+  uint32_t end = pos + len - ECAP_CRC_SIZE;
+
+  if (pos + len == size ||
+      (read(ctx, pos + len, buf, sizeof(buf)) && ecapRecordAt(buf, pos + len, size) > 0)) {
+    return true;
+  }
+  for (uint32_t at = pos + ECAP_RECORD_SIZE; at < end;) {
+    size_t n = end - at < sizeof(buf) ? end - at : sizeof(buf);
+    if (!read(ctx, at, buf, n)) {
+      return false;
+    }
+    crc = ecapCrc(crc, buf, n);
+    at += n;
+  }
+  return read(ctx, end, buf, ECAP_CRC_SIZE) && ecapGet32(buf) == crc;
+}
+
+// Offset of the first whole record at or after pos in a file of size bytes,
+// size when there is none. Where no record starts at pos, e.g. after a
+// record torn by a failed write, the file is searched for the next one.
+static inline uint32_t ecapNext(EcapRead read, void *ctx, uint32_t pos, uint32_t size) {
+  uint8_t buf[ECAP_SCAN + ECAP_RECORD_SIZE + ECAP_META_SIZE];
+  const size_t head = ECAP_RECORD_SIZE + ECAP_META_SIZE;
+
+  while (pos + head <= size) {
+    size_t n = size - pos < sizeof(buf) ? size - pos : sizeof(buf);
+    if (!read(ctx, pos, buf, n)) {
+      break;
+    }
+    for (size_t i = 0; i + head <= n; i++) {
+      uint32_t len;
+      if (ecapGet32(buf + i) == ECAP_RECORD_MAGIC && (len = ecapRecordAt(buf + i, pos + i, size)) > 0 &&
+          ecapRecordWhole(read, ctx, pos + i, len, size)) {
+        return pos + i;
+      }
+    }
+    pos += n - head + 1;
+  }
+  return size;
+}
+
+static inline void ecapFooter(uint8_t *out, uint32_t count, uint32_t offset, uint32_t crc) {
+  ecapPut32(out, ECAP_INDEX_MAGIC);
+  ecapPut32(out + 4, count);
+  ecapPut32(out + 8, offset);
+  ecapPut32(out + 12, crc);
+}
+
+// Reads a footer, false when the file does not end with one.
+static inline bool ecapFooterGet(const uint8_t *in, uint32_t *count, uint32_t *offset, uint32_t *crc) {
+  if (ecapGet32(in) != ECAP_INDEX_MAGIC) {
+    return false;
+  }
+  *count = ecapGet32(in + 4);
+  *offset = ecapGet32(in + 8);
+  *crc = ecapGet32(in + 12);
+  return true;
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+  edgering.h - Edge ring between the RX interrupt and the RF task
+
+  The interrupt handler is the only producer and the RF task is the only
+  consumer, so head is only written by the ISR and tail only by the
+  consumer. Capture keeps running while the previous frame is analysed and
+  logged; edges are only lost when the ring is full, and those are counted
+  in "dropped".
+
+  The ring holds pulse records in the compact encoding of pulses.h; a record
+  is published with a single head update so the consumer never sees part of
+  an escaped pulse.
+
+  RMT blocks are unpacked by rmtDecodeBlock(), rmtBlockIdle() tells a block
+  that ended by idle from one that filled the channel memory. rmtSimulate()
+  packs durations the way the peripheral reports them, the host tests feed
+  the decoder with it.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef EDGERING_h
+#define EDGERING_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pulses.h"
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE 4096          // words per module, must be a power of two
+#endif
+
+typedef struct {
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+  uint16_t buf[CAPTURE_RING_SIZE];
+} EdgeRing;
+
+static inline bool IRAM_ATTR ringPush(EdgeRing *r, uint32_t pulse) {
+  uint16_t enc[PULSE_MAX_WORDS];
+  size_t n = pulseEncode(pulse, enc);
+  uint32_t head = r->head;
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  if (head - tail + n > CAPTURE_RING_SIZE) {
+    r->dropped++;
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    r->buf[(head + i) & (CAPTURE_RING_SIZE - 1)] = enc[i];
+  }
+  __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+  return true;
+}
+
+static inline bool ringPop(EdgeRing *r, uint32_t *pulse) {
+  uint16_t enc[PULSE_MAX_WORDS];
+  uint32_t tail = r->tail;
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  size_t avail = head - tail;
+  if (avail == 0) {
+    return false;
+  }
+  if (avail > PULSE_MAX_WORDS) {
+    avail = PULSE_MAX_WORDS;
+  }
+  for (size_t i = 0; i < avail; i++) {
+    enc[i] = r->buf[(tail + i) & (CAPTURE_RING_SIZE - 1)];
+  }
+  size_t n = pulseDecode(enc, avail, pulse);
+  __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+  return n > 0;
+}
+
+// Glitch filter state. A period shorter than minpulse is a runt: it is added
+// to the pending pulse together with the period after it, so a spike inside a
+// pulse does not split it and levels keep alternating. The pending pulse is
+// pushed to the ring when the next valid period ends, or by captureFlush().
+typedef struct {
+  uint32_t pending;                   // pulse record, 0 when nothing is pending
+  bool absorb;                        // the next period has the pending level
+  volatile uint32_t runts;
+  volatile uint32_t runtsum;          // us spent in runts, for the noise estimate
+} GlitchFilter;
+
+static inline void IRAM_ATTR glitchFilter(GlitchFilter *f, EdgeRing *r, uint32_t pulse, uint32_t minpulse) {
+  uint32_t duration = PULSE_TIME(pulse);
+
+  if (duration < minpulse && !(pulse & EDGE_FRAME_START)) {
+    f->runts++;
+    f->runtsum += duration;
+    if (f->pending) {
+      f->pending = PULSE_EXTEND(f->pending, duration);
+      f->absorb = !f->absorb;
+    }
+    return;
+  }
+  if (f->pending && f->absorb) {
+    f->pending = PULSE_EXTEND(f->pending, duration);
+    f->absorb = false;
+    return;
+  }
+  if (f->pending) {
+    ringPush(r, f->pending);
+  }
+  f->pending = pulse;
+}
+
+// Only call while the interrupt is detached.
+static inline void ringReset(EdgeRing *r) {
+  r->head = 0;
+  r->tail = 0;
+  r->dropped = 0;
+}
+
+// RMT symbol word: duration0:15 level0:1 duration1:15 level1:1
+#define RMT_DURATION(w, n) (((w) >> ((n) * 16)) & 0x7FFF)
+#define RMT_LEVEL(w, n)    (((w) >> ((n) * 16 + 15)) & 1)
+
+// Unpacks one RMT receive block through the glitch filter into the ring.
+// gap is the idle time in us between the previous block and the first edge
+// of this one, it is recorded with the opposite level of the first symbol.
+// A zero duration marks the end of the block. Returns the periods decoded.
+static inline size_t rmtDecodeBlock(GlitchFilter *f, EdgeRing *r, const uint32_t *symbols, size_t count,
+                                    uint32_t gap, uint32_t framegap, uint32_t minpulse) {
+  if (count == 0) {
+    return 0;
+  }
+
+  uint32_t lead = PULSE(!RMT_LEVEL(symbols[0], 0), gap);
+  size_t periods = 0;
+
+  glitchFilter(f, r, gap > framegap ? lead | EDGE_FRAME_START : lead, minpulse);
+
+  for (size_t i = 0; i < count * 2; i++) {
+    uint32_t duration = RMT_DURATION(symbols[i / 2], i % 2);
+
+    if (duration == 0) {
+      break;
+    }
+    glitchFilter(f, r, PULSE(RMT_LEVEL(symbols[i / 2], i % 2), duration), minpulse);
+    periods++;
+  }
+  return periods;
+}
+
+// True when an RMT block ended by idle: it holds the end marker, a zero
+// duration, or less than the capacity of the channel memory. A full block
+// without one stopped recording when the memory filled; the ESP32 cannot wrap
+// its receive memory, so the rest of that burst was lost.
+static inline bool rmtBlockIdle(const uint32_t *symbols, size_t count, size_t capacity) {
+  if (count < capacity || count == 0) {
+    return true;
+  }
+  return RMT_DURATION(symbols[count - 1], 0) == 0 || RMT_DURATION(symbols[count - 1], 1) == 0;
+}
+
+// Simulated RMT source: packs alternating level durations into RMT symbol
+// words the way the peripheral reports them, terminated by a zero duration.
+// symbols must hold count / 2 + 1 words. Returns the number of words written.
+static inline size_t rmtSimulate(const uint32_t *durations, size_t count, bool level, uint32_t *symbols) {
+  size_t n = 0;
+
+  for (size_t i = 0; i <= count; i++) {
+    uint32_t duration = i < count ? durations[i] : 0;
+    if (duration > 0x7FFF) {
+      duration = 0x7FFF;
+    }
+    uint32_t half = duration | ((uint32_t)level << 15);
+    if (i % 2 == 0) {
+      symbols[n] = half;
+    } else {
+      symbols[n++] |= half << 16;
+    }
+    level = !level;
+  }
+  return count % 2 == 0 ? n + 1 : n;
+}
+
+#endif
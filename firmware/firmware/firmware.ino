@@ -1,4 +1,9 @@
 #include "ELECHOUSE_CC1101_SRC_DRV.h"
+#include "capture.h"
+#include "analyzer.h"
+#include "tasks.h"
+#include "logformat.h"
+#include "ecap.h"
 #include <SPI.h>
 #include <ESPmDNS.h>
 #include <WiFiClient.h> 
@@ -8,6 +13,7 @@
 #include <WiFiAP.h>
 #include <LittleFS.h>
 #include "SD.h"
+#include "driver/rmt_rx.h"
 
 // Config SSID, password and hostname
 String defaultSSID = "Evil Crow RF v2";  // Enter your SSID here
@@ -38,28 +44,79 @@ int cs_pin2 = 27;
 
 // RF variables
 #define RECEIVE_ATTR IRAM_ATTR
-#define samplesize 2000
+#define RX_BACKEND_RMT 0      // 1 = hardware timestamped capture with the RMT peripheral
+#define RMT_SYMBOLS 256       // symbols per module, 4 RMT memory blocks each
+#define RMT_IDLE_US 32000     // idle time that ends an RMT receive block
+#define RMT_GLITCH_NS 3000    // the RMT input filter drops shorter pulses
+#define RMT_MIN_PULSE 20      // shortest pulse kept by the RMT backend
+#define GPIO_MIN_PULSE 100    // shortest pulse kept by the GPIO backend
+#define CS_HOLD_OOK 20000     // us without carrier that ends an OOK frame
+#define CS_HOLD_FSK 2000      // FSK keeps the carrier up for the whole frame
+#define ADAPT_INTERVAL 500    // ms between glitch filter updates
+#define RSSI_BUSY_MS 5        // RSSI sample interval while a signal is arriving
+#define RSSI_IDLE_MS 100      // noise floor sample interval
+#define RF_TASK_STACK 8192
+#define STORAGE_TASK_STACK 4096
+#define JAMMER_BURST_MS 50    // jammer time between checks for commands and frames
+#define SYNC_MATCHES 4        // preamble and sync matches logged per frame
+#define AUTOTUNE_STEP 10      // percent the data rate may be off before it is retuned
+#define AUTOTUNE_STABLE 3     // captures in a row within AUTOTUNE_STEP that count as converged
+#define FSK_MIN_SAMPLES 4     // FREQEST readings needed for an estimate
+#define FSK_RSSI_MARGIN 6     // dB above the noise floor for a FREQEST reading to count
+#define FSK_DEV_MIN 1.587     // setDeviation() range in kHz
+#define FSK_DEV_MAX 380.859
 int error_toleranz = 200;
 const int minsample = 30;
-unsigned long sample[samplesize];
-unsigned long samplesmooth[samplesize];
-String lastSampleSmooth;
-int  lastIndex;
-int samplecount;
-static unsigned long lastTime = 0;
+RxContext rxctx[2];
+TaskHandle_t rfTaskHandle = NULL;
+QueueHandle_t rfQueue;
+QueueHandle_t storageQueue;
+TaskStats rfstats = { "rf" };
+TaskStats storagestats = { "storage" };
+uint32_t storagedropped = 0;
+uint32_t storageerrors = 0;
+uint32_t storagewrites = 0;
+SemaphoreHandle_t storageDone;
+CaptureRecord captures[CAPTURE_RECORDS];  // the last captures, by id
+uint32_t capturecount = 0;            // id of the newest record
+portMUX_TYPE capturelock = portMUX_INITIALIZER_UNLOCKED;
+uint32_t bootid;                      // tells /captures clients that the ids restarted
+StorageFile storagefiles[STORAGE_FILES];
+char storagebufs[STORAGE_FILES - 1][STORAGE_BUFFER];
+char storageindexbuf[STORAGE_INDEX_BUFFER];
+volatile uint32_t logfirst = 0;       // oldest log segment
+volatile uint32_t loglast = 0;        // segment written to
+volatile uint32_t logsize = 0;        // bytes in loglast
+char logsegment[24];                  // path of loglast, storage task only
+char logChunks[LOG_CHUNKS][LOG_CHUNK_SIZE + 1];
+QueueHandle_t chunkQueue;             // free log buffers
+LogBuffer rxlog;                      // capture log, written by the RF task
+bool rxlogstart = false;              // the next rxlog chunk opens a capture
+QueueHandle_t ecapQueue;              // free capture record buffers
+int ecapbuffers = 0;                  // allocated, RF task only
+uint32_t ecapsize = 0;                // bytes in captures.ecap, storage task only
+bool ecapindexed = false;             // captures.idx lists every record of it
+volatile bool txbusy = false;
+size_t txlen = 0;
+int jammerModule = -1;
+#if RX_BACKEND_RMT
+rmt_channel_handle_t rmtchan[2];
+rmt_symbol_word_t rmtbuf[2][2][RMT_SYMBOLS];  // per module one block is received while the other is decoded
+int rmtarmed[2];                      // buffer being received into
+volatile bool rmtdone[2];             // a block is complete, set by rmtReceived()
+volatile size_t rmtcount[2];          // its symbols
+volatile unsigned long rmtend[2];     // micros() when it completed
+bool rmtcut[2];                       // the last block filled the channel memory
+#endif
 int mod;
 float deviation;
-int datarate;
 float frequency;
-float setrxbw;
-int power_jammer;
 byte jammer[] = { 0xff, 0xff };
 const size_t jammer_len = sizeof(jammer) / sizeof(jammer[0]);
-long data_to_send[2000];
+uint16_t data_to_send[samplewords];
 
 // Other variables
 const bool formatOnFail = true;
-String OutputLog;
 
 // File
 File logs;
@@ -71,8 +128,6 @@ String tmp_setrxbw;
 String tmp_mod;
 String tmp_deviation;
 String tmp_datarate;
-String raw_rx = "0";
-String jammer_tx = "0";
 String transmit;
 AsyncWebServer controlserver(80);
 
@@ -170,6 +225,303 @@ void handleDeleteWiFiConfig(AsyncWebServerRequest *request) {
   }
 }
 
+// Formats the next piece of a /captures response into c->text: a record,
+// or the tail once the page is done. Returns false after the tail.
+bool captureNext(CaptureCursor *c) {
+  CaptureRecord r;
+  size_t n = 0;
+
+  c->pos = 0;
+  c->len = 0;
+  if (c->id <= c->to) {
+    portENTER_CRITICAL(&capturelock);
+    r = captures[(c->id - 1) % CAPTURE_RECORDS];
+    portEXIT_CRITICAL(&capturelock);
+    if (r.id != c->id) {
+      // Overwritten while the response was sent
+      c->to = c->id - 1;
+    }
+  }
+  if (c->id > c->to) {
+    if (c->done) {
+      return false;
+    }
+    c->len = snprintf(c->text, sizeof(c->text), "],\"next\":%u,\"more\":%s}",
+                      (unsigned)(c->to >= c->from ? c->to : c->since), c->to < c->newest ? "true" : "false");
+    c->done = true;
+    return true;
+  }
+
+  n += snprintf(c->text + n, sizeof(c->text) - n, "%s{\"id\":%u,\"time\":%lu,\"age\":%lu,\"module\":%d,\"mod\":%d",
+                c->id == c->from ? "" : ",", (unsigned)r.id, r.time, c->now - r.time, r.module + 1, r.mod);
+  n += snprintf(c->text + n, sizeof(c->text) - n, ",\"frequency\":%.2f,\"rxbw\":%.2f,\"datarate\":%.2f,\"deviation\":%.2f,\"rssi\":%d",
+                r.frequency, r.setrxbw, r.datarate, r.deviation, r.rssi);
+  n += snprintf(c->text + n, sizeof(c->text) - n, ",\"pulses\":%u,\"duration\":%u,\"shortest\":%u,\"longest\":%u,\"symbol\":%d",
+                (unsigned)r.pulses, (unsigned)r.duration, (unsigned)r.shortest, (unsigned)r.longest, r.symbol);
+  n += snprintf(c->text + n, sizeof(c->text) - n, ",\"messages\":%u,\"frames\":%d", (unsigned)r.messages, r.frames);
+  if (r.decoded.protocol != NULL) {
+    char code[33];
+    decodedCode(&r.decoded, code, sizeof(code));
+    n += snprintf(c->text + n, sizeof(c->text) - n, ",\"protocol\":\"%s\",\"code\":\"%s\",\"codebits\":%d,\"te\":%u,\"repeats\":%d",
+                  r.decoded.protocol->name, code, r.decoded.bits, (unsigned)r.decoded.te, r.repeats);
+  }
+  if (r.line.nbits > 0) {
+    char payload[LINE_BITS / 4 + 1];
+    lineHex(&r.line, payload, sizeof(payload));
+    n += snprintf(c->text + n, sizeof(c->text) - n, ",\"encoding\":\"%s\",\"score\":%d,\"payload\":\"%s\",\"payloadbits\":%d",
+                  lineNames[r.line.code], r.line.score, payload, r.line.nbits);
+  }
+  n += snprintf(c->text + n, sizeof(c->text) - n, "}");
+  c->len = n < sizeof(c->text) ? n : sizeof(c->text) - 1;
+  c->id++;
+  return true;
+}
+
+// Chunk filler of a /captures response, formats as much as fits in buf.
+size_t captureFill(CaptureCursor *c, uint8_t *buf, size_t size) {
+  size_t n = 0;
+
+  while (n < size && (c->pos < c->len || captureNext(c))) {
+    size_t k = c->len - c->pos < size - n ? c->len - c->pos : size - n;
+    memcpy(buf + n, c->text + c->pos, k);
+    c->pos += k;
+    n += k;
+  }
+  return n;
+}
+
+// GET /captures?since=ID&limit=N sends the records after ID, oldest first,
+// so a client polls with the next it was given and only gets new captures.
+// Records overwritten before they were fetched are counted in missed; boot
+// changes when the device restarts and the ids start over. The response is
+// chunked, a page is never held in memory as a whole.
+void handleCaptures(AsyncWebServerRequest *request) {
+  uint32_t since = hasValue(request, "since") ? strtoul(request->arg("since").c_str(), NULL, 10) : 0;
+  int limit = hasValue(request, "limit") ? constrain(request->arg("limit").toInt(), 1, CAPTURE_RECORDS) : CAPTURE_PAGE;
+  uint32_t newest;
+  CaptureCursor c;
+
+  portENTER_CRITICAL(&capturelock);
+  newest = capturecount;
+  portEXIT_CRITICAL(&capturelock);
+  uint32_t oldest = newest > CAPTURE_RECORDS ? newest - CAPTURE_RECORDS + 1 : 1;
+  if (since > newest) {
+    since = 0;
+  }
+  c.since = since;
+  c.from = since + 1 > oldest ? since + 1 : oldest;
+  c.to = c.from + limit - 1 < newest ? c.from + limit - 1 : newest;
+  c.id = c.from;
+  c.newest = newest;
+  c.now = millis();
+  c.done = false;
+  c.pos = 0;
+  c.len = snprintf(c.text, sizeof(c.text), "{\"boot\":\"%08x\",\"oldest\":%u,\"newest\":%u,\"missed\":%u,\"records\":[",
+                   (unsigned)bootid, (unsigned)oldest, (unsigned)newest, (unsigned)(c.from - since - 1));
+
+  request->send(request->beginChunkedResponse("application/json", [c](uint8_t *buf, size_t maxLen, size_t) mutable -> size_t {
+    return captureFill(&c, buf, maxLen);
+  }));
+}
+
+// Sends up to limit bytes of log segment from offset as text. The headers
+// tell where the text came from, so the viewer can ask for what follows or
+// what came before. With align the text starts after the first line break.
+void logPage(AsyncWebServerRequest *request, uint32_t segment, int32_t offset, int32_t limit, bool align) {
+  char path[24];
+  uint8_t buf[512];
+
+  logSegmentPath(segment, path, sizeof(path));
+  File f = SD.open(path, FILE_READ);
+  if (!f) {
+    request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"No such segment\"}");
+    return;
+  }
+  int32_t size = f.size();
+  if (offset < 0) {
+    offset = size > limit ? size - limit : 0;
+  }
+  offset = constrain(offset, 0, size);
+  int32_t end = offset + limit < size ? offset + limit : size;
+  f.seek(offset);
+  if (align && offset > 0) {
+    int32_t n = f.read(buf, end - offset < (int32_t)sizeof(buf) ? end - offset : sizeof(buf));
+    uint8_t *lf = (uint8_t *)memchr(buf, '\n', n > 0 ? n : 0);
+    if (lf != NULL) {
+      offset += lf - buf + 1;
+    }
+    f.seek(offset);
+  }
+
+  AsyncResponseStream *response = request->beginResponseStream("text/plain");
+  response->addHeader("X-Log-Segment", String(segment));
+  response->addHeader("X-Log-Offset", String(offset));
+  response->addHeader("X-Log-Next", String(end));
+  response->addHeader("X-Log-Size", String(size));
+  response->addHeader("X-Log-First", String(logfirst));
+  response->addHeader("X-Log-Last", String(loglast));
+  for (int32_t pos = offset; pos < end; ) {
+    int32_t n = f.read(buf, end - pos < (int32_t)sizeof(buf) ? end - pos : sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    response->write(buf, n);
+    pos += n;
+  }
+  f.close();
+  request->send(response);
+}
+
+// GET /logs?segment=N&offset=O&limit=L sends a page of segment N, by default
+// the current one from the start. GET /logs/tail?limit=L sends its end.
+void handleLogs(AsyncWebServerRequest *request, bool tail) {
+  uint32_t segment = hasValue(request, "segment") ? request->arg("segment").toInt() : loglast;
+  int32_t offset = hasValue(request, "offset") ? request->arg("offset").toInt() : 0;
+  int32_t limit = hasValue(request, "limit") ? constrain(request->arg("limit").toInt(), 1, LOG_PAGE) : LOG_PAGE;
+
+  if (segment == loglast) {
+    storageSyncSoon(LOG_PATH);
+  }
+  logPage(request, segment, tail ? -1 : offset, limit, tail);
+}
+
+// EcapRead of a File, for ecapNext().
+bool ecapFileRead(void *ctx, uint32_t pos, uint8_t *buf, size_t len) {
+  File *f = (File *)ctx;
+  return f->seek(pos) && f->read(buf, len) == len;
+}
+
+// Moves f to the start of record n of a capture file, false when there is
+// no such record. Files from the converter end with an index, for the one
+// written here captures.idx holds the offsets. Without either, records are
+// walked from one header to the next, searching on past damaged ones.
+bool ecapSeek(File &f, uint32_t n) {
+  uint8_t buf[ECAP_RECORD_SIZE + ECAP_META_SIZE];
+  size_t size = f.size();
+  uint32_t count, offset, crc;
+
+  if (f.read(buf, ECAP_HEADER_SIZE) != ECAP_HEADER_SIZE || !ecapCheckHeader(buf)) {
+    return false;
+  }
+  if (size >= ECAP_HEADER_SIZE + ECAP_FOOTER_SIZE && f.seek(size - ECAP_FOOTER_SIZE) &&
+      f.read(buf, ECAP_FOOTER_SIZE) == ECAP_FOOTER_SIZE && ecapFooterGet(buf, &count, &offset, &crc) &&
+      offset + count * 4 + ECAP_FOOTER_SIZE == size) {
+    if (n >= count || !f.seek(offset + n * 4) || f.read(buf, 4) != 4) {
+      return false;
+    }
+    return f.seek(ecapGet32(buf));
+  }
+
+  File index = SD.open(ECAP_INDEX_PATH, FILE_READ);
+  if (index && index.size() % 4 == 0) {
+    bool found = n < index.size() / 4 && ecapFileRead(&index, n * 4, buf, 4);
+    uint32_t pos = ecapGet32(buf);
+    index.close();
+    return found && ecapFileRead(&f, pos, buf, sizeof(buf)) && ecapRecordAt(buf, pos, size) > 0 && f.seek(pos);
+  }
+  index.close();
+
+  uint32_t pos = ECAP_HEADER_SIZE;
+  while ((pos = ecapNext(ecapFileRead, &f, pos, size)) < size) {
+    if (n-- == 0) {
+      return f.seek(pos);
+    }
+    if (!ecapFileRead(&f, pos, buf, sizeof(buf))) {
+      return false;
+    }
+    pos += ecapRecordAt(buf, pos, size);
+  }
+  return false;
+}
+
+// GET /ecap sends captures.ecap as it is; GET /ecap?frame=N sends record N
+// as JSON, with the pulses signed like in the text log.
+void handleEcap(AsyncWebServerRequest *request) {
+  storageSyncSoon(ECAP_PATH);
+  if (!hasValue(request, "frame")) {
+    request->send(SD, ECAP_PATH, "application/octet-stream");
+    return;
+  }
+
+  uint8_t buf[ECAP_META_SIZE + ECAP_DECODED_SIZE];
+  uint16_t words[sizeof(buf) / 2 + PULSE_MAX_WORDS];
+  File f = SD.open(ECAP_PATH, FILE_READ);
+  EcapMeta meta;
+  EcapDecoded dec;
+  uint32_t crc = 0;
+
+  if (!f || !ecapSeek(f, request->arg("frame").toInt()) ||
+      f.read(buf, ECAP_RECORD_SIZE) != ECAP_RECORD_SIZE || ecapRecordBody(buf) == 0 ||
+      f.read(buf, ECAP_META_SIZE) != ECAP_META_SIZE) {
+    f.close();
+    request->send(404, "application/json", "{\"status\":\"error\",\"message\":\"No such frame\"}");
+    return;
+  }
+  crc = ecapCrc(crc, buf, ECAP_META_SIZE);
+  ecapMetaGet(buf, &meta);
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"frame\":%ld,\"time\":%u,\"module\":%u,\"mod\":%u,\"rssi\":%d",
+                   request->arg("frame").toInt(), (unsigned)meta.time, meta.module + 1, meta.mod, meta.rssi);
+  response->printf(",\"frequency\":%u,\"rxbw\":%u,\"datarate\":%u,\"symbol\":%u,\"count\":%u,\"pulses\":[",
+                   (unsigned)meta.frequency, (unsigned)meta.rxbw, (unsigned)meta.datarate,
+                   (unsigned)meta.symbol, (unsigned)meta.pulses);
+
+  // A pulse may straddle two reads, its first words are kept for the next
+  size_t have = 0;
+  uint32_t left = meta.words;
+  bool first = true;
+  while (left > 0) {
+    size_t n = left < sizeof(buf) / 2 ? left : sizeof(buf) / 2;
+    if (f.read(buf, n * 2) != n * 2) {
+      break;
+    }
+    crc = ecapCrc(crc, buf, n * 2);
+    for (size_t k = 0; k < n; k++) {
+      words[have + k] = ecapGet16(buf + k * 2);
+    }
+    have += n;
+    left -= n;
+
+    size_t pos = 0, used;
+    uint32_t pulse;
+    while ((used = pulseDecode(words + pos, have - pos, &pulse)) > 0) {
+      response->printf(first ? "%s%u" : ",%s%u", PULSE_LEVEL(pulse) ? "" : "-", (unsigned)PULSE_TIME(pulse));
+      first = false;
+      pos += used;
+    }
+    memmove(words, words + pos, (have - pos) * 2);
+    have -= pos;
+  }
+  response->print("]");
+
+  bool ok = left == 0 && f.read(buf, ECAP_DECODED_SIZE + ECAP_CRC_SIZE) == ECAP_DECODED_SIZE + ECAP_CRC_SIZE;
+  if (ok) {
+    crc = ecapCrc(crc, buf, ECAP_DECODED_SIZE);
+    ok = crc == ecapGet32(buf + ECAP_DECODED_SIZE);
+    ecapDecodedGet(buf, &dec);
+    const Protocol *pr = protocolFind(dec.protocol);
+    if (pr != NULL) {
+      Decoded d = { pr, dec.code, dec.bits, dec.te };
+      char code[33];
+      decodedCode(&d, code, sizeof(code));
+      response->printf(",\"protocol\":\"%s\",\"code\":\"%s\",\"codebits\":%u,\"te\":%u", pr->name, code, dec.bits, dec.te);
+    }
+    if (dec.linecode < sizeof(lineNames) / sizeof(lineNames[0]) && dec.linebits > 0) {
+      LineCode line;
+      char payload[LINE_BITS / 4 + 1];
+      line.nbits = dec.linebits;
+      memcpy(line.bits, dec.payload, sizeof(line.bits));
+      lineHex(&line, payload, sizeof(payload));
+      response->printf(",\"encoding\":\"%s\",\"payload\":\"%s\",\"payloadbits\":%u",
+                       lineNames[dec.linecode], payload, dec.linebits);
+    }
+  }
+  f.close();
+  response->printf(",\"crc\":\"%s\"}", ok ? "ok" : "bad");
+  request->send(response);
+}
+
 void handleStats(AsyncWebServerRequest *request) {
   uint64_t cardSize = 0;
   uint64_t usedBytes = 0;
@@ -201,6 +553,36 @@ void handleStats(AsyncWebServerRequest *request) {
   json += ",\"sdcard_present\":" + String(sd_present ? "true" : "false");
   json += ",\"totalram\":" + String(ESP.getHeapSize());
   json += ",\"freeram\":" + String(ESP.getFreeHeap());
+  json += ",\"minfreeram\":" + String(ESP.getMinFreeHeap());
+  json += ",\"largestfreeblock\":" + String(ESP.getMaxAllocHeap());
+  json += ",\"log_dropped\":" + String(rxlog.dropped);
+  for (int i = 0; i < 2; i++) {
+    String prefix = ",\"rx" + String(i + 1) + "_";
+    json += prefix + "dropped\":" + String(rxctx[i].ring.dropped);
+    json += prefix + "runts\":" + String(rxctx[i].filter.runts);
+    json += prefix + "gated\":" + String(rxctx[i].gated);
+    json += prefix + "minpulse\":" + String(rxctx[i].minpulse);
+    json += prefix + "noisefloor\":" + String(rxctx[i].noisefloor);
+    json += prefix + "latency_avg\":" + String(rxctx[i].latencycount ? rxctx[i].latencysum / rxctx[i].latencycount : 0);
+    json += prefix + "latency_max\":" + String(rxctx[i].latencymax);
+    json += prefix + "rmt_overflows\":" + String(rxctx[i].rmtoverflows);
+    json += prefix + "rmt_rearm_max\":" + String(rxctx[i].rmtrearm);
+    json += prefix + "autotune\":" + String(!rxctx[i].cfg.autotune ? 0 : rxctx[i].tune.stable >= AUTOTUNE_STABLE ? 2 : 1);
+    json += prefix + "datarate\":" + String(rxctx[i].cfg.datarate, 2);
+    json += prefix + "rxbw\":" + String(rxctx[i].cfg.setrxbw, 2);
+    json += prefix + "retunes\":" + String(rxctx[i].tune.retunes);
+    json += prefix + "freqoffset\":" + String(rxctx[i].freqoffset, 1);
+    json += prefix + "deviation\":" + String(rxctx[i].fskdeviation, 1);
+  }
+  json += taskReport(&rfstats);
+  json += taskReport(&storagestats);
+  TaskHandle_t web = xTaskGetHandle("async_tcp");
+  if (web != NULL) {
+    json += ",\"task_web_stack\":" + String(uxTaskGetStackHighWaterMark(web));
+  }
+  json += ",\"storage_dropped\":" + String(storagedropped);
+  json += ",\"storage_errors\":" + String(storageerrors);
+  json += ",\"storage_writes\":" + String(storagewrites);
   json += ",\"ssid\":\"" + WiFi.SSID() + "\"";
   json += ",\"ipaddress\":\"" + WiFi.localIP().toString() + "\"";
   json += "}";
@@ -208,6 +590,19 @@ void handleStats(AsyncWebServerRequest *request) {
   request->send(200, "application/json", json);
 }
 
+// CPU share since the last report and lowest free stack in bytes of a task.
+String taskReport(TaskStats *t) {
+  unsigned long now = micros();
+  unsigned long elapsed = now - t->since;
+  String prefix = ",\"task_" + String(t->name) + "_";
+  String json = prefix + "cpu\":" + String(elapsed ? t->busy * 100.0 / elapsed : 0.0, 1);
+
+  json += prefix + "stack\":" + String(uxTaskGetStackHighWaterMark(t->handle));
+  t->busy = 0;
+  t->since = now;
+  return json;
+}
+
 void appendFile(fs::FS &fs, const char * path, const char * message, String messagestring){
   logs = fs.open(path, FILE_APPEND);
   if(!logs){
@@ -222,6 +617,10 @@ void appendFile(fs::FS &fs, const char * path, const char * message, String mess
   logs.close();
 }
 
+bool hasValue(AsyncWebServerRequest *request, const char *name) {
+  return request->hasArg(name) && request->arg(name).length() > 0;
+}
+
 void deleteFile(fs::FS &fs, const char * path){
   //Serial.printf("Deleting file: %s\n", path);
   if(fs.remove(path)){
@@ -231,247 +630,1392 @@ void deleteFile(fs::FS &fs, const char * path){
   }
 }
 
-bool checkReceived(void) {
-  delay(1);
-  if (samplecount >= minsample && micros() - lastTime > 100000) {
-    detachInterrupt(rx_pin1);
-    detachInterrupt(rx_pin2);
-    return true;
+#if RX_BACKEND_RMT
+// Receive done callback of the RMT driver, in interrupt context. The block
+// is decoded by rmtPollReceive(), the time it completed is kept for it.
+bool IRAM_ATTR rmtReceived(rmt_channel_handle_t chan, const rmt_rx_done_event_data_t *edata, void *arg) {
+  RxContext *rx = (RxContext *)arg;
+  BaseType_t woken = pdFALSE;
+
+  rmtend[rx->module] = micros();
+  rmtcount[rx->module] = edata->num_symbols;
+  rmtdone[rx->module] = true;
+  rx->notifytime = rmtend[rx->module];
+  if (rfTaskHandle != NULL) {
+    vTaskNotifyGiveFromISR(rfTaskHandle, &woken);
+  }
+  return woken == pdTRUE;
+}
+
+// Starts receiving into the buffer that is not being decoded. The ESP32 RMT
+// cannot wrap its receive memory, so the two buffers take turns here.
+void rmtArm(RxContext *rx) {
+  rmt_receive_config_t config = {};
+  int m = rx->module;
+
+  config.signal_range_min_ns = RMT_GLITCH_NS;
+  config.signal_range_max_ns = RMT_IDLE_US * 1000UL;
+  rmtarmed[m] ^= 1;
+  rmt_receive(rmtchan[m], rmtbuf[m][rmtarmed[m]], sizeof(rmtbuf[m][0]), &config);
+}
+
+void rmtDisableReceive(RxContext *rx) {
+  int m = rx->module;
+
+  if (rmtchan[m] != NULL) {
+    rmt_disable(rmtchan[m]);
+    rmt_del_channel(rmtchan[m]);
+    rmtchan[m] = NULL;
+  }
+}
+
+void rmtEnableReceive(RxContext *rx) {
+  rmt_rx_channel_config_t config = {};
+  rmt_rx_event_callbacks_t callbacks = {};
+  int m = rx->module;
+
+  rmtDisableReceive(rx);
+  config.gpio_num = (gpio_num_t)rx->rxpin;
+  config.clk_src = RMT_CLK_SRC_DEFAULT;
+  config.resolution_hz = 1000000;
+  config.mem_block_symbols = RMT_SYMBOLS;
+  if (rmt_new_rx_channel(&config, &rmtchan[m]) != ESP_OK) {
+    rmtchan[m] = NULL;
+    return;
+  }
+  callbacks.on_recv_done = rmtReceived;
+  rmt_rx_register_event_callbacks(rmtchan[m], &callbacks, rx);
+  rmt_enable(rmtchan[m]);
+  rmtdone[m] = false;
+  rmtcut[m] = false;
+  rmtArm(rx);
+}
+
+// Decodes a completed block. A block that ended by idle ended RMT_IDLE_US
+// after its last edge, so the frame end is known to the latency of the
+// interrupt. A block that filled the channel memory lost the rest of its
+// burst and still ended by idle, after the lost edges: it opens a frame of
+// its own, the next block opens another, and it counts in rmt_overflows.
+void rmtPollReceive(RxContext *rx) {
+  int m = rx->module;
+
+  if (!rmtdone[m]) {
+    return;
+  }
+  rmtdone[m] = false;
+  rmt_symbol_word_t *block = rmtbuf[m][rmtarmed[m]];
+  size_t count = rmtcount[m];
+  unsigned long done = rmtend[m];
+  unsigned long end = done - RMT_IDLE_US;
+
+  // Receive goes on into the other buffer while this one is decoded
+  rmtArm(rx);
+  uint32_t rearm = micros() - done;
+  if (rearm > rx->rmtrearm) {
+    rx->rmtrearm = rearm;
+  }
+
+  bool idle = rmtBlockIdle((const uint32_t *)block, count, RMT_SYMBOLS);
+  unsigned long length = 0;
+  for (size_t s = 0; s < count; s++) {
+    length += block[s].duration0 + block[s].duration1;
+  }
+  unsigned long gap = end - length - rx->lastTime;
+  uint32_t framegap = rx->csstart || rmtcut[m] || !idle ? 0 : rx->framegap;
+
+  rx->csstart = false;
+  rmtcut[m] = !idle;
+  if (!idle) {
+    rx->rmtoverflows++;
+  }
+  rmtDecodeBlock(&rx->filter, &rx->ring, (const uint32_t *)block, count, gap, framegap, rx->minpulse);
+  rx->lastTime = end;
+}
+#endif
+
+// Pushes the pulse held back by the glitch filter once the line is quiet.
+void captureFlush(RxContext *rx) {
+  portENTER_CRITICAL(&rx->lock);
+  if (rx->filter.pending) {
+    ringPush(&rx->ring, rx->filter.pending);
+    rx->filter.pending = 0;
+    rx->filter.absorb = false;
+  }
+  portEXIT_CRITICAL(&rx->lock);
+}
+
+// Tracks the idle RSSI as noise floor and the peak RSSI of the current frame.
+void sampleRssi(RxContext *rx, bool busy) {
+  unsigned long now = millis();
+
+  if (now - rx->rssitime < (busy ? RSSI_BUSY_MS : RSSI_IDLE_MS)) {
+    return;
+  }
+  rx->rssitime = now;
+
+  ELECHOUSE_cc1101.setModul(rx->module);
+  int rssi = ELECHOUSE_cc1101.getRssi();
+
+  if (rx->cfg.trigger == TRIGGER_RSSI && rx->framestate == FRAME_IDLE && rx->histhead > 0 && rssi >= rx->cfg.triggerrssi) {
+    frameBegin(rx);
+    rx->peakrssi = rssi;
+  }
+
+  if (busy) {
+    if (rssi > rx->peakrssi) {
+      rx->peakrssi = rssi;
+    }
+    // The offset estimate is only meaningful while a carrier is present
+    if (rx->cfg.fskestimate && rx->cfg.mod == 0 && rssi >= rx->noisefloor + FSK_RSSI_MARGIN) {
+      freqAdd(&rx->freq, ELECHOUSE_cc1101.getFreqEst());
+    }
   } else {
+    rx->noisefloor = (rx->noisefloor * 7 + rssi) / 8;
+  }
+}
+
+// Moves the runt threshold towards twice the average runt width seen in the
+// last interval, or back to the configured value when the band is clean.
+// It never goes above half of the shortest symbol of the last frame.
+void adaptFilter(RxContext *rx) {
+  unsigned long now = millis();
+
+  if (now - rx->adapttime < ADAPT_INTERVAL) {
+    return;
+  }
+  rx->adapttime = now;
+
+  uint32_t runts = rx->filter.runts - rx->lastruns;
+  uint32_t runtsum = rx->filter.runtsum - rx->lastruntsum;
+  rx->lastruns = rx->filter.runts;
+  rx->lastruntsum = rx->filter.runtsum;
+
+  if (!rx->cfg.adaptive) {
+    rx->minpulse = rx->cfg.minpulsebase;
+    return;
+  }
+
+  uint32_t target = rx->cfg.minpulsebase;
+  if (runts >= 4 && runtsum / runts * 2 > target) {
+    target = runtsum / runts * 2;
+  }
+  if (rx->symbol > 0 && target > (uint32_t)rx->symbol / 2) {
+    target = rx->symbol / 2 > rx->cfg.minpulsebase ? rx->symbol / 2 : rx->cfg.minpulsebase;
+  }
+  rx->minpulse = (rx->minpulse + target) / 2;
+}
+
+uint32_t historyAt(RxContext *rx, uint32_t back) {
+  return rx->history[(rx->histhead - 1 - back) & (HISTORY_SIZE - 1)];
+}
+
+// Adds a pulse to the pre-trigger history and tells if it fires the trigger.
+bool historyPush(RxContext *rx, uint32_t pulse) {
+  uint32_t duration = PULSE_TIME(pulse);
+  uint32_t count = rx->cfg.triggercount > 1 && rx->cfg.triggercount < HISTORY_SIZE ? rx->cfg.triggercount : 2;
+
+  if (rx->histhead >= count) {
+    rx->histsum -= PULSE_TIME(historyAt(rx, count - 1));
+  }
+  if (rx->histhead > 0 && abs((long)duration - (long)PULSE_TIME(historyAt(rx, 0))) <= rx->cfg.error_toleranz) {
+    rx->histrun++;
+  } else {
+    rx->histrun = 1;
+  }
+  rx->history[rx->histhead++ & (HISTORY_SIZE - 1)] = pulse;
+  rx->histsum += duration;
+
+  switch (rx->cfg.trigger) {
+    case TRIGGER_DENSITY:
+      return rx->histhead >= count && rx->histsum <= rx->cfg.triggerwindow;
+    case TRIGGER_PATTERN:
+      return rx->histrun >= (int)count;
+    case TRIGGER_RSSI:
+      return false;
+    default:
+      return (pulse & EDGE_FRAME_START) != 0;
+  }
+}
+
+// Clears the state of the current frame and starts capturing into it.
+void frameReset(RxContext *rx) {
+  rx->samplelen = 0;
+  rx->samplecount = 0;
+  streamReset(&rx->stream, rx->cfg.error_toleranz);
+  codeTallyReset(&rx->codes);
+  lineTallyReset(&rx->lines);
+  rx->decoded.protocol = NULL;
+  rx->repeats = 0;
+  rx->line.nbits = 0;
+  rx->framestart = rx->messages;
+  freqReset(&rx->freq);
+  rx->peakrssi = -128;
+  rx->csseen = rx->carrier;
+  rx->postcount = 0;
+  rx->framefull = false;
+  rx->framestate = FRAME_CAPTURE;
+}
+
+// Starts a frame with the last pretrigger pulses of the history. The pulse
+// before them becomes the lead-in, like the gap of a gap triggered frame.
+void frameBegin(RxContext *rx) {
+  uint32_t pre = rx->cfg.trigger == TRIGGER_GAP ? 0 : rx->cfg.pretrigger;
+
+  if (pre > HISTORY_SIZE - 1) {
+    pre = HISTORY_SIZE - 1;
+  }
+  if (pre > rx->histhead - 1) {
+    pre = rx->histhead - 1;
+  }
+
+  frameReset(rx);
+  for (int i = pre; i >= 0; i--) {
+    pulseAppend(rx->sample, &rx->samplelen, samplewords, historyAt(rx, i) & ~EDGE_FRAME_START);
+    rx->samplecount++;
+    if (i < (int)pre) {
+      streamFeed(rx, historyAt(rx, i) & ~EDGE_FRAME_START);
+    }
+  }
+  rx->histhead = 0;
+  rx->histsum = 0;
+  rx->histrun = 0;
+}
+
+// Publishes the message the stream analyzer just finished.
+void streamMessage(RxContext *rx) {
+  StreamAnalyzer *a = &rx->stream;
+  RxMessage msg;
+  int n = a->nbits < MESSAGE_CHARS ? a->nbits : MESSAGE_CHARS;
+
+  msg.time = millis();
+  msg.symbol = a->symbol;
+  msg.nbits = a->nbits;
+  for (int i = 0; i < n; i++) {
+    msg.bits[i] = a->bits[i / 8] & (0x80 >> (i % 8)) ? '1' : '0';
+  }
+  msg.bits[n] = 0;
+
+  if (decodeMessage(a->pulses, a->count, &msg.decoded)) {
+    codeTallyAdd(&rx->codes, &msg.decoded);
+    rx->decoded = *codeTallyBest(&rx->codes, &rx->repeats);
+  }
+
+  int linerepeats;
+  lineDecode(a->pulses, a->count, streamUnit(a), &msg.line);
+  lineTallyAdd(&rx->lines, &msg.line);
+  if (rx->lines.n > 0) {
+    rx->line = *lineTallyBest(&rx->lines, &linerepeats);
+  }
+
+  portENTER_CRITICAL(&rx->msglock);
+  rx->message = msg;
+  rx->messages++;
+  portEXIT_CRITICAL(&rx->msglock);
+}
+
+void streamFeed(RxContext *rx, uint32_t pulse) {
+  if (streamPulse(&rx->stream, pulse)) {
+    streamMessage(rx);
+  }
+}
+
+// Time at which the current message ends if no further edge arrives,
+// 0 when no message is open.
+unsigned long streamEndTime(RxContext *rx) {
+  uint32_t symbol = streamSymbol(&rx->stream);
+
+  if (rx->framestate != FRAME_CAPTURE || symbol == 0 || rx->stream.count == 0 || rx->stream.done) {
+    return 0;
+  }
+  return rx->lastTime + symbol * STREAM_PAUSE;
+}
+
+// Back to waiting for a trigger, or straight on with the next frame when the
+// last one ended because the buffer was full.
+void frameDone(RxContext *rx) {
+  if (rx->framefull) {
+    frameReset(rx);
+    return;
+  }
+  rx->samplelen = 0;
+  rx->samplecount = 0;
+  rx->postcount = 0;
+  rx->framestate = FRAME_IDLE;
+}
+
+// Feeds one pulse into frame assembly, see framer.h. Returns FRAME_*.
+int framePulse(void *ctx, uint32_t pulse) {
+  RxContext *rx = (RxContext *)ctx;
+
+  if (rx->framestate == FRAME_CAPTURE) {
+    if (!frameSplits(pulse, rx->samplecount)) {
+      // A frame that continues a full one gets an empty lead-in
+      if (rx->samplecount == 0) {
+        frameAppend(rx->sample, samplewords, &rx->samplelen, &rx->samplecount, PULSE(!PULSE_LEVEL(pulse), 0));
+      }
+      bool full = frameAppend(rx->sample, samplewords, &rx->samplelen, &rx->samplecount, pulse & ~EDGE_FRAME_START);
+      rx->postcount++;
+      streamFeed(rx, pulse & ~EDGE_FRAME_START);
+      if (full) {
+        rx->framefull = true;
+        return FRAME_ENDED;
+      }
+      return rx->cfg.posttrigger > 0 && rx->postcount >= rx->cfg.posttrigger ? FRAME_ENDED : FRAME_OPEN;
+    }
+    // A gap ended the frame before this pulse, which may start the next one
+    if (rx->samplecount >= rx->cfg.minsample) {
+      return FRAME_SPLIT;
+    }
+    frameDone(rx);
+  }
+
+  if (historyPush(rx, pulse)) {
+    frameBegin(rx);
+  }
+  return FRAME_OPEN;
+}
+
+// Time at which the line counts as quiet if nothing else arrives. With carrier
+// sense that is the hold time after the carrier went away, instead of framegap
+// after the last edge.
+unsigned long rxQuietTime(RxContext *rx) {
+  unsigned long last = rx->lastTime;
+
+  if (!rx->cfg.carriersense) {
+    return last + rx->framegap;
+  }
+  if (rx->carrier) {
+    return micros() + rx->cshold;
+  }
+  if ((long)(rx->csdrop - last) > 0) {
+    last = rx->csdrop;
+  }
+  return last + rx->cshold;
+}
+
+bool rxQuiet(RxContext *rx) {
+  return (long)(micros() - rxQuietTime(rx)) > 0;
+}
+
+// Ticks the RF task may sleep before this module needs it again, unless an
+// interrupt wakes it earlier.
+TickType_t rxWait(RxContext *rx) {
+#if RX_BACKEND_RMT
+  // Completed RMT blocks wake the task, quiet time and RSSI are polled
+  return 1;
+#else
+  long wait = (rxQuiet(rx) ? RSSI_IDLE_MS : RSSI_BUSY_MS) * 1000L;
+
+  if (rx->framestate == FRAME_CAPTURE) {
+    long remaining = (long)(rxQuietTime(rx) - micros());
+    if (remaining < wait) {
+      wait = remaining > 0 ? remaining : 0;
+    }
+    unsigned long streamend = streamEndTime(rx);
+    remaining = (long)(streamend - micros());
+    if (streamend != 0 && remaining < wait) {
+      wait = remaining > 0 ? remaining : 0;
+    }
+  }
+  return wait / 1000 / portTICK_PERIOD_MS + 1;
+#endif
+}
+
+void rxLatency(RxContext *rx) {
+  uint32_t latency = micros() - rx->frameend;
+
+  if (latency > rx->latencymax) {
+    rx->latencymax = latency;
+  }
+  rx->latencysum += latency;
+  rx->latencycount++;
+}
+
+bool checkReceived(RxContext *rx) {
+  bool quiet = rxQuiet(rx);
+
+#if RX_BACKEND_RMT
+  rmtPollReceive(rx);
+#endif
+
+  // A message ends after a pause of a few symbols, long before framegap
+  unsigned long streamend = streamEndTime(rx);
+  bool paused = streamend != 0 && (long)(micros() - streamend) > 0;
+
+  adaptFilter(rx);
+  if (quiet || paused) {
+    captureFlush(rx);
+  }
+
+  bool complete = frameFill(&rx->ring, &rx->held, framePulse, rx);
+
+  sampleRssi(rx, !quiet);
+
+  // Silence after the last queued pulse ends the frame
+  if (!complete && quiet && rx->framestate == FRAME_CAPTURE && rx->ring.head == rx->ring.tail) {
+    if (rx->samplecount < rx->cfg.minsample) {
+      frameDone(rx);
+      return false;
+    }
+    complete = true;
+    rx->frameend = rxQuietTime(rx);
+  } else if (complete) {
+    rx->frameend = rx->notifytime;
+  }
+
+  if ((paused || complete) && streamIdle(&rx->stream)) {
+    streamMessage(rx);
+  }
+
+  if (!complete) {
+    return false;
+  }
+
+  // Noise gate: drop frames that never rose far enough above the noise floor,
+  // or never raised carrier sense
+  if ((rx->cfg.rssigate > 0 && rx->peakrssi < rx->noisefloor + rx->cfg.rssigate) || (rx->cfg.carriersense && !rx->csseen)) {
+    rx->gated++;
+    frameDone(rx);
     return false;
   }
+  return true;
 }
 
-void printReceived() {
-  OutputLog = "";
-  appendFile(SD, "/logs.txt", "-------------------------------------------------------\n", "");
-  //Serial.print("Count=");
-  //Serial.println(samplecount);
-  OutputLog += "\n";
-  OutputLog += "Count=";
-  OutputLog += String(samplecount);
-  OutputLog += "\n";
+// Log sink of rxlog: queues a filled buffer for the storage task and takes
+// the next free one. A buffer the queue cannot take goes back to the pool.
+// The first buffer of a capture carries rxlogstart, see logAppend().
+char *logChunk(void *ctx, char *buf, size_t len) {
+  char *next = NULL;
+
+  if (buf != NULL) {
+    StorageItem item = { STORAGE_APPEND, (const char *)ctx, buf, len, chunkQueue, rxlogstart };
+    if (xQueueSend(storageQueue, &item, 0) != pdPASS) {
+      storagedropped++;
+      xQueueSend(chunkQueue, &buf, 0);
+    }
+    rxlogstart = false;
+  }
+  if (xQueueReceive(chunkQueue, &next, pdMS_TO_TICKS(STORAGE_WAIT_MS)) != pdPASS) {
+    storagedropped++;
+    return NULL;
+  }
+  return next;
+}
 
-  for (int i = 0; i < samplecount; i++) {
-    //Serial.print(sample[i]);
-    //Serial.print(",");
-    OutputLog += String(sample[i]);
-    OutputLog += ",";
+// Writes the buffered bytes of a file, opening it first if needed. A new
+// capture file starts with the .ecap header. A failed write closes the file
+// so the next one reopens it, e.g. after the card was reinserted.
+void storageWrite(StorageFile *f) {
+  if (f->len == 0) {
+    return;
+  }
+  if (!f->file) {
+    f->file = SD.open(f->path, FILE_APPEND);
+    if (f->file && f->file.size() == 0 && strcmp(f->path, ECAP_PATH) == 0) {
+      uint8_t header[ECAP_HEADER_SIZE];
+      ecapHeader(header);
+      if (f->file.write(header, sizeof(header)) != sizeof(header)) {
+        f->file.close();
+      }
+    }
+  }
+  if (f->file && f->file.write((const uint8_t *)f->buf, f->len) == f->len) {
+    storagewrites++;
+    f->dirty = true;
+  } else {
+    storageerrors++;
+    f->file.close();
+    if (strcmp(f->path, ECAP_PATH) == 0 || strcmp(f->path, ECAP_INDEX_PATH) == 0) {
+      ecapindexed = false;
+    }
   }
-  //Serial.println();
-  //Serial.println();
-  OutputLog += "\n";
-  appendFile(SD, "/logs.txt", NULL, OutputLog.c_str());
+  f->len = 0;
 }
 
-void RECEIVE_ATTR receiver() {
-  const long time = micros();
-  const unsigned int duration = time - lastTime;
+void storageSync(StorageFile *f) {
+  storageWrite(f);
+  if (f->file && f->dirty) {
+    f->file.flush();
+  }
+  f->dirty = false;
+}
 
-  if (duration > 100000) {
-    samplecount = 0;
+void storageFilesInit() {
+  for (int i = 0; i < STORAGE_FILES - 1; i++) {
+    storagefiles[i].buf = storagebufs[i];
+    storagefiles[i].size = STORAGE_BUFFER;
   }
+  storagefiles[STORAGE_FILES - 1].buf = storageindexbuf;
+  storagefiles[STORAGE_FILES - 1].size = STORAGE_INDEX_BUFFER;
+}
 
-  if (duration >= 100 && samplecount < samplesize) {
-    sample[samplecount++] = duration;
+// Slot of an open file, or a free one, or the first one closed for reuse.
+// captures.idx always gets the last slot, other files the rest.
+StorageFile *storageFile(const char *path) {
+  StorageFile *slot = NULL;
+  int first = strcmp(path, ECAP_INDEX_PATH) == 0 ? STORAGE_FILES - 1 : 0;
+  int last = first == 0 ? STORAGE_FILES - 1 : STORAGE_FILES;
+
+  for (int i = first; i < last; i++) {
+    StorageFile *f = &storagefiles[i];
+    if (f->path != NULL && strcmp(f->path, path) == 0) {
+      return f;
+    }
+    if (f->path == NULL && slot == NULL) {
+      slot = f;
+    }
   }
+  if (slot == NULL) {
+    slot = &storagefiles[first];
+    storageSync(slot);
+    slot->file.close();
+  }
+  slot->path = path;
+  slot->len = 0;
+  slot->dirty = false;
+  return slot;
+}
 
-  /*if (duration >= 100) {
-    sample[samplecount++] = duration;
-  }*/
+void storageAppend(const char *path, const char *data, size_t len) {
+  StorageFile *f = storageFile(path);
+
+  while (len > 0) {
+    size_t part = len < f->size - f->len ? len : f->size - f->len;
+    memcpy(f->buf + f->len, data, part);
+    f->len += part;
+    data += part;
+    len -= part;
+    if (f->len == f->size) {
+      storageWrite(f);
+    }
+  }
+}
 
-  if (samplecount >= samplesize) {
-    samplecount = samplesize - 1;
-    bool received = checkReceived();
-    if (received) {}
-    detachInterrupt(rx_pin1);
-    detachInterrupt(rx_pin2);
+void storageSyncAll() {
+  for (int i = 0; i < STORAGE_FILES; i++) {
+    if (storagefiles[i].path != NULL) {
+      storageSync(&storagefiles[i]);
+    }
   }
+}
 
-  if (mod == 0) {
-    if (samplecount == 1 and digitalRead(rx_pin2) != HIGH){
-      samplecount = 0;
+bool storagePending() {
+  for (int i = 0; i < STORAGE_FILES; i++) {
+    if (storagefiles[i].len > 0 || storagefiles[i].dirty) {
+      return true;
     }
+  }
+  return false;
+}
+
+void logSegmentPath(uint32_t segment, char *out, size_t size) {
+  snprintf(out, size, LOG_DIR "/%06u.txt", (unsigned)segment);
+}
+
+void logIndexWrite() {
+  File index = SD.open(LOG_INDEX, FILE_WRITE);
+  if (index) {
+    index.printf("%u %u\n", (unsigned)logfirst, (unsigned)loglast);
+    index.close();
+  }
+}
 
-    else if (samplecount == 1 and digitalRead(rx_pin1) != HIGH){
-      samplecount = 0;
+// Finds the segments at boot. A logs.txt of older firmware becomes the
+// first segment.
+void logSegmentsInit() {
+  char text[24] = "";
+  File index = SD.open(LOG_INDEX, FILE_READ);
+
+  if (index) {
+    text[index.read((uint8_t *)text, sizeof(text) - 1)] = 0;
+    index.close();
+    char *end;
+    logfirst = strtoul(text, &end, 10);
+    loglast = strtoul(end, NULL, 10);
+    if (loglast < logfirst) {
+      loglast = logfirst;
     }
+  } else {
+    SD.mkdir(LOG_DIR);
+    logfirst = 0;
+    loglast = 0;
+    if (SD.exists(LOG_PATH)) {
+      logSegmentPath(0, text, sizeof(text));
+      SD.rename(LOG_PATH, text);
+    }
+    logIndexWrite();
+  }
+  logSegmentPath(loglast, logsegment, sizeof(logsegment));
+  File cur = SD.open(logsegment, FILE_READ);
+  logsize = cur ? cur.size() : 0;
+  cur.close();
+}
+
+// Closes the current segment and starts the next one.
+void logRotate() {
+  char path[24];
+  StorageFile *f = storageFile(logsegment);
+
+  storageSync(f);
+  f->file.close();
+  f->path = NULL;
+  loglast++;
+  while (loglast - logfirst >= LOG_SEGMENTS) {
+    logSegmentPath(logfirst, path, sizeof(path));
+    SD.remove(path);
+    logfirst++;
   }
+  logIndexWrite();
+  logSegmentPath(loglast, logsegment, sizeof(logsegment));
+  logsize = 0;
+}
 
-  lastTime = time;
+// Segments start with a capture unless one runs far past the segment size.
+// start tells that the text opens a capture.
+void logAppend(const char *text, size_t len, bool start) {
+  if (logsize >= LOG_SEGMENT_SIZE && (start || logsize >= LOG_SEGMENT_SIZE + LOG_SEGMENT_SLACK)) {
+    logRotate();
+  }
+  storageAppend(logsegment, text, len);
+  logsize += len;
 }
 
-void signalanalyse(){
-  OutputLog = "";
-  #define signalstorage 10
+void logDelete() {
+  char path[24];
+  StorageFile *f = storageFile(logsegment);
 
-  int signalanz=0;
-  int timingdelay[signalstorage];
-  //float pulse[signalstorage];
-  long signaltimings[signalstorage*2];
-  int signaltimingscount[signalstorage];
-  long signaltimingssum[signalstorage];
-  long signalsum=0;
-  
-  for (int i = 0; i<signalstorage; i++){
-    signaltimings[i*2] = 100000;
-    signaltimings[i*2+1] = 0;
-    signaltimingscount[i] = 0;
-    signaltimingssum[i] = 0;
+  f->file.close();
+  f->path = NULL;
+  for (uint32_t s = logfirst; s <= loglast; s++) {
+    logSegmentPath(s, path, sizeof(path));
+    SD.remove(path);
   }
-  for (int i = 1; i<samplecount; i++){
-    signalsum+=sample[i];
+  logfirst = 0;
+  loglast = 0;
+  logsize = 0;
+  logIndexWrite();
+  logSegmentPath(loglast, logsegment, sizeof(logsegment));
+}
+
+// Checks captures.idx against captures.ecap: the last offset has to be a
+// record that ends the file. Otherwise, after a failed write or on a card
+// from older firmware, the index is rebuilt by walking the records.
+void ecapIndexInit() {
+  uint8_t head[ECAP_RECORD_SIZE + ECAP_META_SIZE];
+  StorageFile *f = storageFile(ECAP_PATH);
+  StorageFile *x = storageFile(ECAP_INDEX_PATH);
+
+  storageSync(f);
+  storageSync(x);
+  f->file.close();
+  x->file.close();
+
+  File ecap = SD.open(ECAP_PATH, FILE_READ);
+  File index = SD.open(ECAP_INDEX_PATH, FILE_READ);
+  uint32_t size = ecap ? ecap.size() : 0;
+  uint32_t count = index ? index.size() / 4 : 0;
+  bool ok = index ? index.size() % 4 == 0 : size == 0;
+  if (ok && count == 0) {
+    ok = size <= ECAP_HEADER_SIZE;
+  } else if (ok) {
+    uint32_t last = ecapFileRead(&index, (count - 1) * 4, head, 4) ? ecapGet32(head) : size;
+    ok = ecapFileRead(&ecap, last, head, sizeof(head)) && ecapRecordAt(head, last, size) == size - last;
+  }
+  index.close();
+
+  ecapsize = size;
+  ecapindexed = true;
+  if (!ok) {
+    SD.remove(ECAP_INDEX_PATH);
+    uint32_t pos = ECAP_HEADER_SIZE;
+    while ((pos = ecapNext(ecapFileRead, &ecap, pos, size)) < size && ecapFileRead(&ecap, pos, head, sizeof(head))) {
+      uint8_t offset[4];
+      ecapPut32(offset, pos);
+      storageAppend(ECAP_INDEX_PATH, (const char *)offset, sizeof(offset));
+      pos += ecapRecordAt(head, pos, size);
+    }
+    storageSync(x);
   }
+  ecap.close();
+}
 
-  for (int p = 0; p<signalstorage; p++){
+// Appends a record to captures.ecap and its offset to captures.idx,
+// checking the index first when a write failed since.
+void ecapAppend(const char *record, size_t len) {
+  uint8_t offset[4];
 
-  for (int i = 1; i<samplecount; i++){
-    if (p==0){
-      if (sample[i]<signaltimings[p*2]){
-        signaltimings[p*2]=sample[i];
+  if (!ecapindexed) {
+    ecapIndexInit();
+  }
+  if (ecapsize < ECAP_HEADER_SIZE) {
+    ecapsize = ECAP_HEADER_SIZE;        // storageWrite() starts the file with the header
+  }
+  ecapPut32(offset, ecapsize);
+  storageAppend(ECAP_INDEX_PATH, (const char *)offset, sizeof(offset));
+  storageAppend(ECAP_PATH, record, len);
+  ecapsize += len;
+}
+
+void ecapDelete() {
+  const char *paths[] = { ECAP_PATH, ECAP_INDEX_PATH };
+
+  for (const char *path : paths) {
+    StorageFile *f = storageFile(path);
+    f->file.close();
+    f->path = NULL;
+    SD.remove(path);
+  }
+  ecapsize = 0;
+  ecapindexed = true;
+}
+
+void storageTask(void *arg) {
+  StorageItem item;
+  unsigned long synctime = millis();
+
+  storageFilesInit();
+  logSegmentsInit();
+  ecapIndexInit();
+  storagestats.since = micros();
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    if (storagePending()) {
+      long left = STORAGE_FLUSH_MS - (long)(millis() - synctime);
+      wait = left > 0 ? pdMS_TO_TICKS(left) : 0;
+    }
+    bool received = xQueueReceive(storageQueue, &item, wait) == pdPASS;
+    unsigned long start = micros();
+
+    if (!received) {
+      storageSyncAll();
+      synctime = millis();
+    } else if (item.op == STORAGE_APPEND) {
+      if (strcmp(item.path, LOG_PATH) == 0) {
+        logAppend(item.text, item.len, item.start);
+      } else if (strcmp(item.path, ECAP_PATH) == 0) {
+        ecapAppend(item.text, item.len);
+      } else {
+        storageAppend(item.path, item.text, item.len);
       }
-    }else{
-      if (sample[i]<signaltimings[p*2] && sample[i]>signaltimings[p*2-1]){
-        signaltimings[p*2]=sample[i];
+      xQueueSend(item.pool, &item.text, portMAX_DELAY);
+    } else if (item.op == STORAGE_SYNC) {
+      storageSync(storageFile(strcmp(item.path, LOG_PATH) == 0 ? logsegment : item.path));
+      if (strcmp(item.path, ECAP_PATH) == 0) {
+        storageSync(storageFile(ECAP_INDEX_PATH));
       }
+      synctime = millis();
+    } else if (item.op == STORAGE_DELETE && strcmp(item.path, LOG_PATH) == 0) {
+      logDelete();
+      xSemaphoreGive(storageDone);
+    } else if (item.op == STORAGE_DELETE && strcmp(item.path, ECAP_PATH) == 0) {
+      ecapDelete();
+      xSemaphoreGive(storageDone);
+    } else if (item.op == STORAGE_DELETE) {
+      StorageFile *f = storageFile(item.path);
+      f->file.close();
+      f->path = NULL;
+      SD.remove(item.path);
+      xSemaphoreGive(storageDone);
     }
+    taskBusy(&storagestats, start);
   }
+}
 
-  for (int i = 1; i<samplecount; i++){
-    if (sample[i]<signaltimings[p*2]+error_toleranz && sample[i]>signaltimings[p*2+1]){
-      signaltimings[p*2+1]=sample[i];
-    }
+// Has the storage task write out and sync a file, without waiting: the web
+// handlers run on the async_tcp task and serve what the card holds, which
+// is never more than STORAGE_FLUSH_MS behind. When the queue is full the
+// periodic sync does it.
+void storageSyncSoon(const char *path) {
+  StorageItem item = { STORAGE_SYNC, path, NULL, 0, NULL, false };
+
+  xQueueSend(storageQueue, &item, 0);
+}
+
+// Has the storage task delete a file and waits until it is done.
+bool storageRequest(StorageOp op, const char *path) {
+  StorageItem item = { op, path, NULL, 0, NULL, false };
+
+  xSemaphoreTake(storageDone, 0);
+  if (xQueueSend(storageQueue, &item, pdMS_TO_TICKS(STORAGE_DELETE_WAIT_MS)) != pdPASS) {
+    return false;
   }
+  return xSemaphoreTake(storageDone, pdMS_TO_TICKS(STORAGE_DELETE_WAIT_MS)) == pdTRUE;
+}
 
-  for (int i = 1; i<samplecount; i++){
-    if (sample[i]>=signaltimings[p*2] && sample[i]<=signaltimings[p*2+1]){
-      signaltimingscount[p]++;
-      signaltimingssum[p]+=sample[i];
+void printReceived(RxContext *rx) {
+  LogBuffer *log = &rxlog;
+
+  logFlush(log);                        // the capture starts a chunk of its own
+  rxlogstart = true;
+  logStr(log, "-------------------------------------------------------\n");
+  logStr(log, "Module=");
+  logUint(log, rx->module + 1);
+  logStr(log, " Frequency=");
+  logFixed(log, rx->cfg.frequency, 2);
+  logStr(log, " Mod=");
+  logInt(log, rx->cfg.mod);
+  logStr(log, " RSSI=");
+  logInt(log, rx->peakrssi);
+  logStr(log, "\nCount=");
+  logUint(log, rx->samplecount);
+  logChar(log, '\n');
+
+  PulseReader rd;
+  uint32_t pulse;
+  pulseReaderInit(&rd, rx->sample, rx->samplelen);
+  while (pulseNext(&rd, &pulse)) {
+    if (!PULSE_LEVEL(pulse)) {
+      logChar(log, '-');
     }
+    logUint(log, PULSE_TIME(pulse));
+    logChar(log, ',');
   }
+  logChar(log, '\n');
+  logFlush(log);
+}
+
+// Adds the capture to the records of /captures. Called after signalanalyse()
+// like ecapStore().
+void captureStore(RxContext *rx) {
+  CaptureRecord r;
+  PulseReader rd;
+  uint32_t pulse;
+
+  r.time = millis();
+  r.module = rx->module;
+  r.mod = rx->cfg.mod;
+  r.frequency = rx->cfg.frequency;
+  r.setrxbw = rx->cfg.setrxbw;
+  r.datarate = rx->cfg.datarate;
+  r.deviation = rx->cfg.deviation;
+  r.rssi = rx->peakrssi;
+  r.pulses = 0;
+  r.duration = 0;
+  r.shortest = 0;
+  r.longest = 0;
+  pulseReaderInit(&rd, rx->sample, rx->samplelen);
+  pulseNext(&rd, &pulse);
+  while (pulseNext(&rd, &pulse)) {
+    uint32_t t = PULSE_TIME(pulse);
+    r.duration += t;
+    r.shortest = r.pulses == 0 || t < r.shortest ? t : r.shortest;
+    r.longest = t > r.longest ? t : r.longest;
+    r.pulses++;
+  }
+  r.symbol = rx->symbol > 0 ? rx->symbol : 0;
+  r.messages = rx->messages - rx->framestart;
+  r.frames = rx->vote.repeats;
+  r.decoded = rx->decoded;
+  r.repeats = rx->repeats;
+  r.line = rx->line;
+
+  portENTER_CRITICAL(&capturelock);
+  r.id = ++capturecount;
+  captures[(r.id - 1) % CAPTURE_RECORDS] = r;
+  portEXIT_CRITICAL(&capturelock);
+}
+
+// Appends the capture as a record of captures.ecap, see ecap.h. Called after
+// signalanalyse() so the record holds the symbol time and what was decoded.
+// The record goes to the storage task whole or not at all.
+void ecapStore(RxContext *rx) {
+  char *rec;
+  EcapMeta meta;
+  EcapDecoded dec;
+
+  if (ecapbuffers == 0 || xQueueReceive(ecapQueue, &rec, pdMS_TO_TICKS(STORAGE_WAIT_MS)) != pdPASS) {
+    storagedropped++;
+    return;
   }
-  int firstsample = signaltimings[0];
-  signalanz=signalstorage;
 
-  for (int i = 0; i<signalstorage; i++){
-    if (signaltimingscount[i] == 0){
-      signalanz=i;
-      i=signalstorage;
+  meta.time = millis();
+  meta.module = rx->module;
+  meta.mod = rx->cfg.mod;
+  meta.rssi = constrain(rx->peakrssi, -128, 127);
+  meta.flags = 0;
+  meta.frequency = (uint32_t)(rx->cfg.frequency * 1e6 + 0.5);
+  meta.rxbw = (uint32_t)(rx->cfg.setrxbw * 1000 + 0.5f);
+  meta.datarate = (uint32_t)(rx->cfg.datarate * 1000 + 0.5f);
+  meta.symbol = rx->symbol > 0 ? rx->symbol : 0;
+  meta.pulses = rx->samplecount;
+  meta.words = rx->samplelen;
+
+  memset(&dec, 0, sizeof(dec));
+  if (rx->decoded.protocol != NULL) {
+    strncpy(dec.protocol, rx->decoded.protocol->name, ECAP_NAME_SIZE - 1);
+    dec.code = rx->decoded.code;
+    dec.bits = rx->decoded.bits;
+    dec.te = rx->decoded.te < 0xFFFF ? rx->decoded.te : 0xFFFF;
+  }
+  dec.linecode = rx->line.nbits > 0 ? rx->line.code : ECAP_NO_LINE;
+  dec.linebits = rx->line.nbits;
+  memcpy(dec.payload, rx->line.bits, ECAP_PAYLOAD_SIZE);
+
+  size_t len = ecapRecordPut((uint8_t *)rec, &meta, rx->sample, &dec);
+  StorageItem item = { STORAGE_APPEND, ECAP_PATH, rec, len, ecapQueue, false };
+  if (xQueueSend(storageQueue, &item, 0) != pdPASS) {
+    storagedropped++;
+    xQueueSend(ecapQueue, &rec, 0);
+  }
+}
+
+// Capture record buffers are a whole frame each, so they are only allocated
+// while a module stores captures in captures.ecap. Called by the RF task
+// after every command. Without memory for a buffer records are dropped and
+// counted like any other. A buffer still with the storage task is freed
+// after a later command.
+void ecapPoolUpdate() {
+  bool used = (rxctx[0].active && rxctx[0].cfg.ecap) || (rxctx[1].active && rxctx[1].cfg.ecap);
+  char *rec;
+
+  while (used && ecapbuffers < ECAP_BUFFERS) {
+    rec = (char *)malloc(ECAP_RECORD_BYTES(samplewords));
+    if (rec == NULL) {
+      break;
     }
+    xQueueSend(ecapQueue, &rec, 0);
+    ecapbuffers++;
   }
+  while (!used && ecapbuffers > 0 && xQueueReceive(ecapQueue, &rec, pdMS_TO_TICKS(STORAGE_WAIT_MS)) == pdPASS) {
+    free(rec);
+    ecapbuffers--;
+  }
+}
+
+// Wakes the RF task from an interrupt, for a frame boundary or a filling ring.
+void RECEIVE_ATTR rxNotify(RxContext *rx) {
+  BaseType_t woken = pdFALSE;
 
-  for (int s=1; s<signalanz; s++){
-  for (int i=0; i<signalanz-s; i++){
-    if (signaltimingscount[i] < signaltimingscount[i+1]){
-      int temp1 = signaltimings[i*2];
-      int temp2 = signaltimings[i*2+1];
-      int temp3 = signaltimingssum[i];
-      int temp4 = signaltimingscount[i];
-      signaltimings[i*2] = signaltimings[(i+1)*2];
-      signaltimings[i*2+1] = signaltimings[(i+1)*2+1];
-      signaltimingssum[i] = signaltimingssum[i+1];
-      signaltimingscount[i] = signaltimingscount[i+1];
-      signaltimings[(i+1)*2] = temp1;
-      signaltimings[(i+1)*2+1] = temp2;
-      signaltimingssum[i+1] = temp3;
-      signaltimingscount[i+1] = temp4;
+  rx->notifytime = micros();
+  if (rfTaskHandle != NULL) {
+    vTaskNotifyGiveFromISR(rfTaskHandle, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+void RECEIVE_ATTR receiver(void *arg) {
+  RxContext *rx = (RxContext *)arg;
+  const unsigned long time = micros();
+  const unsigned long duration = time - rx->lastTime;
+  // The period that just ended has the opposite level of the pin now
+  uint32_t pulse = PULSE(digitalRead(rx->rxpin) != HIGH, duration);
+
+  if (duration > rx->framegap || rx->csstart) {
+    pulse |= EDGE_FRAME_START;
+    rx->csstart = false;
+  }
+
+  portENTER_CRITICAL_ISR(&rx->lock);
+  glitchFilter(&rx->filter, &rx->ring, pulse, rx->minpulse);
+  portEXIT_CRITICAL_ISR(&rx->lock);
+
+  rx->lastTime = time;
+
+  if ((pulse & EDGE_FRAME_START) || rx->ring.head - rx->ring.tail > CAPTURE_RING_SIZE / 2) {
+    rxNotify(rx);
+  }
+}
+
+// Carrier sense output of the CC1101 on GDO0. A carrier that comes up after
+// the hold time marks the next edge as the start of a frame.
+void RECEIVE_ATTR carrierSense(void *arg) {
+  RxContext *rx = (RxContext *)arg;
+  const unsigned long time = micros();
+
+  if (digitalRead(rx->cspin) == HIGH) {
+    if (!rx->carrier && time - rx->csdrop > rx->cshold) {
+      rx->csstart = true;
     }
+    rx->carrier = true;
+    rx->csseen = true;
+  } else {
+    rx->carrier = false;
+    rx->csdrop = time;
+    // The frame end moved, let the RF task sleep until then
+    rxNotify(rx);
+  }
+}
+
+// Smooths the symbol time over captures and moves the data rate and the
+// receive filter to it once the current setting is AUTOTUNE_STEP percent off.
+// Runs in the RF task, which owns the radio, between two captures.
+void rxAutotune(RxContext *rx) {
+  RxTune *t = &rx->tune;
+  uint32_t symbol = rx->symbol;
+
+  if (symbol == 0) {
+    return;
   }
+  t->symbol = t->symbol ? (3 * t->symbol + symbol) / 4 : symbol;
+  uint32_t diff = symbol > t->symbol ? symbol - t->symbol : t->symbol - symbol;
+  t->stable = diff * 100 <= t->symbol * AUTOTUNE_STEP ? t->stable + 1 : 0;
+
+  float datarate = rateEstimate(t->symbol);
+  float rxbw = bandwidthEstimate(datarate, rx->cfg.mod, rx->cfg.deviation, rx->cfg.frequency);
+  if (fabsf(datarate - rx->cfg.datarate) * 100 <= rx->cfg.datarate * AUTOTUNE_STEP && bandwidthStep(rxbw) == bandwidthStep(rx->cfg.setrxbw)) {
+    return;
   }
 
-  for (int i=0; i<signalanz; i++){
-    timingdelay[i] = signaltimingssum[i]/signaltimingscount[i];
+  rx->cfg.datarate = datarate;
+  rx->cfg.setrxbw = rxbw;
+  ELECHOUSE_cc1101.setModul(rx->module);
+  ELECHOUSE_cc1101.setSidle();
+  ELECHOUSE_cc1101.setDRate(datarate);
+  ELECHOUSE_cc1101.setRxBW(rxbw);
+  ELECHOUSE_cc1101.SetRx();
+  t->retunes++;
+}
+
+// Estimates the carrier offset and deviation of a 2-FSK capture from the
+// FREQEST readings taken while it arrived and retunes the module to them.
+// The offset is the mean reading, the deviation half the spread between the
+// 10th and 90th percentile, so a few readings on a transition do not count.
+//
+// FREQEST is the estimate of the frequency offset compensation loop, meant
+// for the carrier offset. The loop filter smooths it over several symbols and
+// the readings are not timed to the symbols, so the spread mostly shows how
+// far the loop follows the modulation and depends on the data rate and
+// FOCCFG. The deviation is therefore only applied with
+// FSK_ESTIMATE_DEVIATION, otherwise it is logged as a hint.
+// Returns false when the capture had too few readings.
+bool rxFskEstimate(RxContext *rx) {
+  FreqSamples *f = &rx->freq;
+
+  if (f->samples < FSK_MIN_SAMPLES) {
+    return false;
+  }
+  float offset = f->sum * FREQEST_KHZ / f->samples;
+  float deviation = (freqPercentile(f, 90) - freqPercentile(f, 10)) * FREQEST_KHZ / 2;
+  deviation = constrain(deviation, FSK_DEV_MIN, FSK_DEV_MAX);
+  rx->freqoffset = offset;
+  rx->fskdeviation = deviation;
+
+  bool applydev = rx->cfg.fskestimate == FSK_ESTIMATE_DEVIATION;
+  bool retune = fabsf(offset) >= FREQEST_KHZ;
+  retune |= applydev && fabsf(deviation - rx->cfg.deviation) * 100 > rx->cfg.deviation * AUTOTUNE_STEP;
+  if (!retune) {
+    return true;
   }
 
-  if (firstsample == sample[1] and firstsample < timingdelay[0]){
-    sample[1] = timingdelay[0];
+  rx->cfg.frequency += offset / 1000;
+  if (applydev) {
+    rx->cfg.deviation = deviation;
   }
+  ELECHOUSE_cc1101.setModul(rx->module);
+  ELECHOUSE_cc1101.setSidle();
+  ELECHOUSE_cc1101.setMHZ(rx->cfg.frequency);
+  ELECHOUSE_cc1101.setDeviation(rx->cfg.deviation);
+  ELECHOUSE_cc1101.SetRx();
+  return true;
+}
 
-  bool lastbin=0;
-  for (int i=1; i<samplecount; i++){
-    float r = (float)sample[i]/timingdelay[0];
-    int calculate = r;
-    r = r-calculate;
-    r*=10;
-    if (r>=5){calculate+=1;}
-    if (calculate>0){
-      if (lastbin==0){
-        lastbin=1;
-      }else{
-      lastbin=0;
-    }
-      if (lastbin==0 && calculate>8){
-        //Serial.print(" [Pause: ");
-        //Serial.print(sample[i]);
-        //Serial.println(" samples]");
-        OutputLog += " [Pause: ";
-        OutputLog += String(sample[i]);
-        OutputLog += " samples]\n";
+// Searches the bits of one frame between pauses for a pattern and keeps
+// the matches for the log.
+void frameSearch(const FrameVote *vote, int frame, const BitPattern *p, int maxerrors, SyncHits *hits) {
+  BitMatch match[SYNC_MATCHES];
+  int n = patternSearch(vote->cur, vote->curbits, 0, p, maxerrors, match, SYNC_MATCHES);
+
+  for (int i = 0; i < n; i++, hits->count++) {
+    if (hits->count < SYNC_HITS) {
+      hits->frame[hits->count] = frame;
+      hits->match[hits->count] = match[i];
+    }
+  }
+}
+
+// Logs the matches as frame:bit/errors.
+void logHits(LogBuffer *log, const char *name, const SyncHits *hits) {
+  logStr(log, name);
+  if (hits->count == 0) {
+    logStr(log, "none");
+  }
+  for (int i = 0; i < hits->count && i < SYNC_HITS; i++) {
+    if (i > 0) {
+      logChar(log, ' ');
+    }
+    logUint(log, hits->frame[i]);
+    logChar(log, ':');
+    logUint(log, hits->match[i].offset);
+    logChar(log, '/');
+    logUint(log, hits->match[i].errors);
+  }
+  if (hits->count > SYNC_HITS) {
+    logStr(log, " ...");
+  }
+  logChar(log, '\n');
+}
+
+// Starts a pass over the pulses of a frame, skipping the lead-in gap.
+void framePulses(RxContext *rx, PulseReader *rd) {
+  uint32_t lead;
+  pulseReaderInit(rd, rx->sample, rx->samplelen);
+  pulseNext(rd, &lead);
+}
+
+// Pattern search of signalanalyse(), see FrameRepeat in analyzer.h.
+void frameHits(void *ctx, const FrameVote *vote, int frame) {
+  FrameHits *h = (FrameHits *)ctx;
 
+  frameSearch(vote, frame, &h->cfg->preamble, h->cfg->syncerrors, &h->preambles);
+  frameSearch(vote, frame, &h->cfg->sync, h->cfg->syncerrors, &h->syncs);
+}
+
+void signalanalyse(RxContext *rx){
+  LogBuffer *log = &rxlog;
+  PulseReader rd;
+  uint32_t pulse;
+
+  // Repeat votes and pattern matches come first, the text is written from
+  // further passes over the pulses once it is known what to write
+  SymbolQuantizer quant;
+  FrameVote *vote = &rx->vote;
+  FrameHits hits = { &rx->cfg };
+  FrameResult result;
+
+  frameAnalyse(rx->sample, rx->samplelen, rx->cfg.error_toleranz, &quant, vote, frameHits, &hits, &result);
+  if (result.symbol == 0) {
+    logStr(log, "-------------------------------------------------------\n");
+    logFlush(log);
+    return;
+  }
+  int symbol = result.symbol;
+  rx->symbol = symbol;
+
+  logChar(log, '\n');
+
+  // Repeats of one frame are logged once, as their majority. The whole
+  // train is kept when some frames did not match it.
+  if (vote->repeats >= 2) {
+    int nbits = voteLength(vote);
+    logStr(log, "Frame x");
+    logUint(log, vote->repeats);
+    logStr(log, " (majority vote");
+    if (vote->rejected) {
+      logStr(log, ", ");
+      logUint(log, vote->rejected);
+      logStr(log, " frames differ");
+    }
+    logStr(log, "):\n");
+    for (int i = 0; i < nbits; i++) {
+      logChar(log, voteMajority(vote, i) ? '1' : '0');
+    }
+    logStr(log, "\nConfidence:\n");
+    for (int i = 0; i < nbits; i++) {
+      int tenths = voteConfidence(vote, i) / 10;
+      logChar(log, '0' + (tenths > 9 ? 9 : tenths));
+    }
+    logChar(log, '\n');
+  }
+  if (vote->repeats < 2 || vote->rejected) {
+    framePulses(rx, &rd);
+    while (pulseNext(&rd, &pulse)){
+      int calculate = quantize(&quant, PULSE_TIME(pulse));
+      bool lastbin = PULSE_LEVEL(pulse);
+      if (lastbin==0 && calculate>FRAME_PAUSE){
+        logStr(log, " [Pause: ");
+        logUint(log, PULSE_TIME(pulse));
+        logStr(log, " samples]\n");
       } else{
         for (int b=0; b<calculate; b++){
-          //Serial.print(lastbin);
-          OutputLog += String(lastbin);
+          logChar(log, '0' + lastbin);
         }
       }
     }
   }
-  //Serial.println();
-  //Serial.print("Samples/Symbol: ");
-  //Serial.println(timingdelay[0]);
-  //Serial.println();
-  OutputLog += "\nSamples/Symbol: ";
-  OutputLog += String(timingdelay[0]);
-  OutputLog += "\n\n";
+  logStr(log, "\nSamples/Symbol: ");
+  logUint(log, symbol);
+  logChar(log, '\n');
+  if (rx->cfg.autotune) {
+    rxAutotune(rx);
+    logStr(log, "Autotune: DataRate=");
+    logFixed(log, rx->cfg.datarate, 2);
+    logStr(log, " kBaud RxBW=");
+    logFixed(log, rx->cfg.setrxbw, 2);
+    logStr(log, rx->tune.stable >= AUTOTUNE_STABLE ? " kHz, converged\n" : " kHz, tuning\n");
+  }
+  if (rx->cfg.fskestimate && rx->cfg.mod == 0) {
+    if (rxFskEstimate(rx)) {
+      logStr(log, "FSK: Offset=");
+      logFixed(log, rx->freqoffset, 1);
+      logStr(log, " kHz Deviation=");
+      logFixed(log, rx->fskdeviation, 1);
+      logStr(log, rx->cfg.fskestimate == FSK_ESTIMATE_DEVIATION ? " kHz, now Frequency=" : " kHz (not applied), now Frequency=");
+      logFixed(log, rx->cfg.frequency, 4);
+      logStr(log, " Deviation=");
+      logFixed(log, rx->cfg.deviation, 1);
+      logChar(log, '\n');
+    } else {
+      logStr(log, "FSK: too few FREQEST readings\n");
+    }
+  }
+  if (rx->decoded.protocol != NULL) {
+    char code[33];
+    decodedCode(&rx->decoded, code, sizeof(code));
+    logStr(log, "Protocol=");
+    logStr(log, rx->decoded.protocol->name);
+    logStr(log, " Code=");
+    logStr(log, code);
+    logStr(log, " Bits=");
+    logUint(log, rx->decoded.bits);
+    logStr(log, " TE=");
+    logUint(log, rx->decoded.te);
+    logStr(log, " Repeats=");
+    logUint(log, rx->repeats);
+    logChar(log, '\n');
+  }
+  if (rx->cfg.preamble.len) {
+    logHits(log, "Preamble=", &hits.preambles);
+  }
+  if (rx->cfg.sync.len) {
+    logHits(log, "Sync=", &hits.syncs);
+  }
+  if (rx->line.nbits > 0) {
+    char payload[LINE_BITS / 4 + 1];
+    lineHex(&rx->line, payload, sizeof(payload));
+    logStr(log, "Encoding=");
+    logStr(log, lineNames[rx->line.code]);
+    logStr(log, " Score=");
+    logUint(log, rx->line.score);
+    logStr(log, " Bits=");
+    logUint(log, rx->line.nbits);
+    logStr(log, " Payload=");
+    logStr(log, payload);
+    logChar(log, '\n');
+  }
+  logChar(log, '\n');
+
+  logStr(log, "Rawdata corrected:\nCount=");
+  logUint(log, result.counted + 1);
+  logChar(log, '\n');
+  framePulses(rx, &rd);
+  while (pulseNext(&rd, &pulse)){
+    int calculate = quantize(&quant, PULSE_TIME(pulse));
+    if (calculate>0){
+      if (!PULSE_LEVEL(pulse)) {
+        logChar(log, '-');
+      }
+      logUint(log, calculate*symbol);
+      logChar(log, ',');
+    }
+  }
+  logChar(log, '\n');
+  logStr(log, "-------------------------------------------------------\n");
+  logFlush(log);
+}
 
-  int smoothcount=0;
+void rxInit(RxContext *rx, byte module, int rxpin, int cspin) {
+  rx->module = module;
+  rx->rxpin = digitalPinToInterrupt(rxpin);
+  rx->cspin = digitalPinToInterrupt(cspin);
+  rx->cfg.carriersense = false;
+  rx->cfg.csthreshold = 0;
+  rx->cfg.cshold = 0;
+  rx->cfg.error_toleranz = error_toleranz;
+  rx->cfg.minsample = minsample;
+  rx->cfg.minpulsebase = RX_BACKEND_RMT ? RMT_MIN_PULSE : GPIO_MIN_PULSE;
+  rx->minpulse = rx->cfg.minpulsebase;
+  rx->cfg.adaptive = false;
+  rx->cfg.rssigate = 0;
+  rx->cfg.framegap = FRAME_GAP;
+  rx->noisefloor = -100;
+  rx->cfg.trigger = TRIGGER_GAP;
+  rx->cfg.pretrigger = 0;
+  rx->cfg.posttrigger = 0;
+  rx->cfg.triggerrssi = -70;
+  rx->cfg.triggercount = 16;
+  rx->cfg.triggerwindow = 20000;
+  rx->cfg.preamble.len = 0;
+  rx->cfg.sync.len = 0;
+  rx->cfg.syncerrors = 0;
+  rx->cfg.autotune = false;
+  rx->cfg.fskestimate = FSK_ESTIMATE_OFF;
+  rx->cfg.ecap = false;
+  rx->freqoffset = 0;
+  rx->fskdeviation = 0;
+  freqReset(&rx->freq);
+  rx->lock = portMUX_INITIALIZER_UNLOCKED;
+  rx->msglock = portMUX_INITIALIZER_UNLOCKED;
+  rx->messages = 0;
+  rx->framestart = 0;
+  rx->message.nbits = 0;
+  rx->message.symbol = 0;
+  rx->message.decoded.protocol = NULL;
+  rx->message.line.nbits = 0;
+  codeTallyReset(&rx->codes);
+  lineTallyReset(&rx->lines);
+  rx->decoded.protocol = NULL;
+  rx->repeats = 0;
+  rx->line.nbits = 0;
+  rx->message.bits[0] = 0;
+  rx->active = false;
+  rx->samplelen = 0;
+  rx->samplecount = 0;
+}
 
-  for (int i=1; i<samplecount; i++){
-    float r = (float)sample[i]/timingdelay[0];
-    int calculate = r;
-    r = r-calculate;
-    r*=10;
-    if (r>=5){calculate+=1;}
-    if (calculate>0){
-      samplesmooth[smoothcount] = calculate*timingdelay[0];
-      smoothcount++;
-    }
-  }
-  appendFile(SD, "/logs.txt", NULL, "\n");
-  //Serial.println("Rawdata corrected:");
-  //Serial.print("Count=");
-  //Serial.println(smoothcount+1);
-  lastIndex = smoothcount - 1;
-  lastSampleSmooth = samplesmooth[lastIndex];
-
-  OutputLog += "Rawdata corrected:\n";
-  OutputLog += "Count=";
-  OutputLog += String(smoothcount + 1);
-  OutputLog += "\n";
-
-  for (int i=0; i<smoothcount; i++){
-    //Serial.print(samplesmooth[i]);
-    //Serial.print(",");
-    OutputLog += String(samplesmooth[i]);
-    OutputLog += ",";
-  }
-  //Serial.println();
-  //Serial.println();
-  appendFile(SD, "/logs.txt", NULL, OutputLog.c_str());
-  appendFile(SD, "/logs.txt", NULL, "\n");
-  appendFile(SD, "/logs.txt", "-------------------------------------------------------\n", "");
-  return;
-}
-
-void enableReceive() {
-  rx_pin1 = digitalPinToInterrupt(rx_pin1);
-  rx_pin2 = digitalPinToInterrupt(rx_pin2);
-  pinMode(rx_pin1, INPUT);
-  pinMode(rx_pin2, INPUT);
+void enableReceive(RxContext *rx) {
+  pinMode(rx->rxpin, INPUT);
+  ELECHOUSE_cc1101.setModul(rx->module);
   ELECHOUSE_cc1101.SetRx();
-  samplecount = 0;
-  attachInterrupt(rx_pin1, receiver, CHANGE);
-  attachInterrupt(rx_pin2, receiver, CHANGE);
+  detachInterrupt(rx->rxpin);
+  ringReset(&rx->ring);
+  memset(&rx->filter, 0, sizeof(rx->filter));
+  rx->lastruns = 0;
+  rx->lastruntsum = 0;
+  rx->gated = 0;
+  rx->symbol = 0;
+  rx->minpulse = rx->cfg.minpulsebase;
+  rx->framegap = rx->cfg.framegap;
+  rx->samplelen = 0;
+  rx->samplecount = 0;
+  rx->histhead = 0;
+  rx->histsum = 0;
+  rx->histrun = 0;
+  rx->held = 0;
+  rx->framestate = FRAME_IDLE;
+  rx->framefull = false;
+  rx->carrier = false;
+  rx->csstart = false;
+  rx->csseen = false;
+  rx->csdrop = micros();
+  rx->latencymax = 0;
+  rx->latencysum = 0;
+  rx->latencycount = 0;
+  rx->rmtoverflows = 0;
+  rx->rmtrearm = 0;
+  rx->tune.symbol = 0;
+  rx->tune.stable = 0;
+  rx->tune.retunes = 0;
+  if (rx->cfg.carriersense) {
+    // OOK drops the carrier in every low period, so hold it past the longest gap inside a frame
+    rx->cshold = rx->cfg.cshold;
+    if (rx->cshold == 0) {
+      rx->cshold = rx->cfg.mod == 2 ? CS_HOLD_OOK : CS_HOLD_FSK;
+    }
+    ELECHOUSE_cc1101.setCarrierSense(rx->cfg.csthreshold, 0);
+    ELECHOUSE_cc1101.setGDOMode(0, 0x0E);
+    pinMode(rx->cspin, INPUT);
+    attachInterruptArg(rx->cspin, carrierSense, rx, CHANGE);
+  }
+  rx->active = true;
+#if RX_BACKEND_RMT
+  rx->lastTime = micros();
+  rmtEnableReceive(rx);
+#else
+  attachInterruptArg(rx->rxpin, receiver, rx, CHANGE);
+#endif
+}
+
+void disableReceive(RxContext *rx) {
+  rx->active = false;
+#if RX_BACKEND_RMT
+  rmtDisableReceive(rx);
+#else
+  detachInterrupt(rx->rxpin);
+#endif
+  detachInterrupt(rx->cspin);
+  ELECHOUSE_cc1101.setModul(rx->module);
+  ELECHOUSE_cc1101.setSidle();
+  ELECHOUSE_cc1101.setGDOMode(0, 0x0D);
 }
 
 void setup() {
@@ -505,16 +2049,34 @@ void setup() {
     request->send(SD, "/HTML/viewlog.html", "text/html");
   });
 
+  // Registered before /logs, which would take them as well
+  controlserver.on("/logs/tail", HTTP_GET, [](AsyncWebServerRequest *request){
+    handleLogs(request, true);
+  });
+
+  controlserver.on("/logs/index", HTTP_GET, [](AsyncWebServerRequest *request){
+    String json = "{\"first\":" + String(logfirst);
+    json += ",\"last\":" + String(loglast);
+    json += ",\"size\":" + String(logsize);
+    json += ",\"segmentsize\":" + String(LOG_SEGMENT_SIZE);
+    json += ",\"page\":" + String(LOG_PAGE) + "}";
+    request->send(200, "application/json", json);
+  });
+
   controlserver.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(SD, "/logs.txt", "text/plain");
+    handleLogs(request, false);
   });
 
   controlserver.on("/txconfig", HTTP_GET, [](AsyncWebServerRequest *request) {
     request->send(SD, "/HTML/txconfig.html", "text/html");
   });
 
+  controlserver.on("/ecap", HTTP_GET, handleEcap);
+  controlserver.on("/captures", HTTP_GET, handleCaptures);
+
   controlserver.on("/delete", HTTP_POST, [](AsyncWebServerRequest *request){
-    deleteFile(SD, "/logs.txt");
+    storageRequest(STORAGE_DELETE, LOG_PATH);
+    storageRequest(STORAGE_DELETE, ECAP_PATH);
     request->send(200, "application/json", "{\"status\":\"deleted\"}");
   });
 
@@ -556,49 +2118,156 @@ void setup() {
     tmp_deviation = request->arg("deviation");
     tmp_datarate = request->arg("datarate");
 
+    if (tmp_module != "1" && tmp_module != "2") {
+      request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid module (must be 1 or 2)\"}");
+      return;
+    }
+
     if (request->hasArg("configmodule")) {
-      frequency = tmp_frequency.toFloat();
-      setrxbw = tmp_setrxbw.toFloat();
-      mod = tmp_mod.toInt();
-      deviation = tmp_deviation.toFloat();
-      datarate = tmp_datarate.toInt();
-
-      if (tmp_module == "1") {
-        ELECHOUSE_cc1101.setModul(0);
-        ELECHOUSE_cc1101.Init();
-      } else if (tmp_module == "2") {
-        ELECHOUSE_cc1101.setModul(1);
-        ELECHOUSE_cc1101.Init();
-      }
-
-      if (mod == 2) {
-        ELECHOUSE_cc1101.setDcFilterOff(0);
-      } else if (mod == 0) {
-        ELECHOUSE_cc1101.setDcFilterOff(1);
-        ELECHOUSE_cc1101.setDeviation(deviation);
-      }
-
-      ELECHOUSE_cc1101.setModulation(mod);
-      ELECHOUSE_cc1101.setMHZ(frequency);
-      ELECHOUSE_cc1101.setSyncMode(0);
-      ELECHOUSE_cc1101.setPktFormat(3);
-      ELECHOUSE_cc1101.setRxBW(setrxbw);
-      ELECHOUSE_cc1101.setDRate(datarate);
-      enableReceive();
-      raw_rx = "1";
+      RfCommand cmd;
+      RxConfig *rx = &cmd.rx;
+
+      cmd.type = RF_RX_START;
+      cmd.module = (tmp_module == "1") ? 0 : 1;
+      cmd.rx = rxctx[cmd.module].cfg;
+      rx->frequency = tmp_frequency.toFloat();
+      rx->setrxbw = tmp_setrxbw.toFloat();
+      rx->mod = tmp_mod.toInt();
+      rx->deviation = tmp_deviation.toFloat();
+      rx->datarate = tmp_datarate.toFloat();
+
+      // Optional glitch filter and noise gate settings
+      if (hasValue(request, "minpulse")) {
+        rx->minpulsebase = request->arg("minpulse").toInt();
+      }
+      if (hasValue(request, "adaptive")) {
+        rx->adaptive = request->arg("adaptive") == "1";
+      }
+      if (hasValue(request, "rssigate")) {
+        rx->rssigate = request->arg("rssigate").toInt();
+      }
+      if (hasValue(request, "framegap")) {
+        rx->framegap = request->arg("framegap").toInt() * 1000;
+      }
+      if (hasValue(request, "minsample")) {
+        rx->minsample = request->arg("minsample").toInt();
+      }
+
+      // Optional carrier sense on GDO0
+      if (hasValue(request, "carriersense")) {
+        rx->carriersense = request->arg("carriersense").toInt() == 1;
+      }
+      if (hasValue(request, "csthreshold")) {
+        rx->csthreshold = request->arg("csthreshold").toInt();
+      }
+      rx->cshold = hasValue(request, "cshold") ? request->arg("cshold").toInt() * 1000 : 0;
+
+      // Optional capture trigger
+      if (hasValue(request, "trigger")) {
+        rx->trigger = request->arg("trigger").toInt();
+      }
+      if (hasValue(request, "pretrigger")) {
+        rx->pretrigger = request->arg("pretrigger").toInt();
+      }
+      if (hasValue(request, "posttrigger")) {
+        rx->posttrigger = request->arg("posttrigger").toInt();
+      }
+      if (hasValue(request, "triggerrssi")) {
+        rx->triggerrssi = request->arg("triggerrssi").toInt();
+      }
+      if (hasValue(request, "triggercount")) {
+        rx->triggercount = request->arg("triggercount").toInt();
+      }
+      if (hasValue(request, "triggerwindow")) {
+        rx->triggerwindow = request->arg("triggerwindow").toInt() * 1000;
+      }
+
+      // Optional preamble and sync word search, in bits or 0x hex
+      if (request->hasArg("preamble") && !patternParse(request->arg("preamble").c_str(), &rx->preamble)) {
+        request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid preamble pattern\"}");
+        return;
+      }
+      if (request->hasArg("sync") && !patternParse(request->arg("sync").c_str(), &rx->sync)) {
+        request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid sync pattern\"}");
+        return;
+      }
+      if (hasValue(request, "syncerrors")) {
+        rx->syncerrors = request->arg("syncerrors").toInt();
+      }
+
+      // Optional closed loop data rate and filter tuning
+      if (hasValue(request, "autotune")) {
+        rx->autotune = request->arg("autotune").toInt() == 1;
+      }
+      if (hasValue(request, "fskestimate")) {
+        rx->fskestimate = constrain(request->arg("fskestimate").toInt(), FSK_ESTIMATE_OFF, FSK_ESTIMATE_DEVIATION);
+      }
+      if (hasValue(request, "ecap")) {
+        rx->ecap = request->arg("ecap").toInt() == 1;
+      }
+
+      if (!rfSend(&cmd)) {
+        request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Radio busy, try again\"}");
+        return;
+      }
       request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"RX configuration applied successfully.\"}");
     } else {
       request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing configmodule parameter\"}");
     }
   });
 
+  controlserver.on("/messages", HTTP_GET, [](AsyncWebServerRequest *request) {
+    String json = "{";
+    for (int i = 0; i < 2; i++) {
+      RxContext *rx = &rxctx[i];
+      RxMessage msg;
+      uint32_t count;
+
+      portENTER_CRITICAL(&rx->msglock);
+      msg = rx->message;
+      count = rx->messages;
+      portEXIT_CRITICAL(&rx->msglock);
+
+      json += i ? ",\"rx2\":{" : "\"rx1\":{";
+      json += "\"count\":" + String(count);
+      json += ",\"age\":" + String(count ? millis() - msg.time : 0);
+      json += ",\"symbol\":" + String(msg.symbol);
+      json += ",\"nbits\":" + String(msg.nbits);
+      json += ",\"bits\":\"" + String(msg.bits) + "\"";
+      if (count && msg.decoded.protocol != NULL) {
+        char code[33];
+        decodedCode(&msg.decoded, code, sizeof(code));
+        json += ",\"protocol\":\"" + String(msg.decoded.protocol->name) + "\"";
+        json += ",\"code\":\"" + String(code) + "\"";
+        json += ",\"codebits\":" + String(msg.decoded.bits);
+        json += ",\"te\":" + String(msg.decoded.te);
+      }
+      if (count && msg.line.nbits > 0) {
+        char payload[LINE_BITS / 4 + 1];
+        lineHex(&msg.line, payload, sizeof(payload));
+        json += ",\"encoding\":\"" + String(lineNames[msg.line.code]) + "\"";
+        json += ",\"payload\":\"" + String(payload) + "\"";
+        json += ",\"payloadbits\":" + String(msg.line.nbits);
+      }
+      json += "}";
+    }
+    json += "}";
+    request->send(200, "application/json", json);
+  });
+
   controlserver.on("/stoprx", HTTP_POST, [](AsyncWebServerRequest *request) {
-    ELECHOUSE_cc1101.setModul(0);
-    ELECHOUSE_cc1101.setSidle();
-    ELECHOUSE_cc1101.setModul(1);
-    ELECHOUSE_cc1101.setSidle();
+    // Without a module parameter both modules are stopped
+    String module = request->hasArg("module") ? request->arg("module") : "";
+
+    RfCommand cmd;
+
+    cmd.type = RF_RX_STOP;
+    for (cmd.module = 0; cmd.module < 2; cmd.module++) {
+      if (module != String(2 - cmd.module)) {
+        rfSend(&cmd);
+      }
+    }
 
-    raw_rx = "0";
     request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"RX stopped.\"}");
   });
 
@@ -609,6 +2278,11 @@ void setup() {
       return;
     }
 
+    if (txbusy) {
+      request->send(409, "text/plain", "Transmitter busy");
+      return;
+    }
+
     tmp_module = request->arg("module");
     tmp_frequency = request->arg("frequency");
     transmit = request->arg("rawdata");
@@ -617,38 +2291,44 @@ void setup() {
 
     int counter = 0;
     int pos = 0;
+    txlen = 0;
     frequency = tmp_frequency.toFloat();
     deviation = tmp_deviation.toFloat();
     mod = tmp_mod.toInt();
 
-    for (int i = 0; i < transmit.length(); i++){
-      if (transmit.substring(i, i+1) == ",") {
-        data_to_send[counter++] = transmit.substring(pos, i).toInt();
+    // Negative values are low periods as logged by the receiver,
+    // without them the data alternates high and low starting high
+    bool leveltagged = transmit.indexOf('-') >= 0;
+
+    for (int i = 0; i <= transmit.length(); i++){
+      if (i == transmit.length() || transmit.charAt(i) == ',') {
+        if (i > pos) {
+          long value = transmit.substring(pos, i).toInt();
+          bool level = leveltagged ? value > 0 : counter % 2 == 0;
+          if (!pulseAppend(data_to_send, &txlen, samplewords, PULSE(level, (uint32_t)abs(value)))) {
+            break;
+          }
+          counter++;
+        }
         pos = i+1;
       }
     }
-    if (pos < transmit.length()) data_to_send[counter++] = transmit.substring(pos).toInt();
 
-    int tx_pin = (tmp_module == "1") ? 2 : 25;
-    ELECHOUSE_cc1101.setModul((tmp_module == "1") ? 0 : 1);
-    ELECHOUSE_cc1101.Init();
-    ELECHOUSE_cc1101.setModulation(mod);
-    ELECHOUSE_cc1101.setMHZ(frequency);
-    ELECHOUSE_cc1101.setDeviation(deviation);
-    ELECHOUSE_cc1101.SetTx();
-    pinMode(tx_pin, OUTPUT);
-
-    for (int i = 0; i < counter; i += 2) {
-      digitalWrite(tx_pin, HIGH);
-      delayMicroseconds(data_to_send[i]);
-      digitalWrite(tx_pin, LOW);
-      delayMicroseconds(data_to_send[i+1]);
-      //Serial.print(data_to_send[i]);
-      //Serial.print(",");
+    RfCommand cmd;
+    cmd.type = RF_TX_RAW;
+    cmd.module = (tmp_module == "1") ? 0 : 1;
+    cmd.mod = mod;
+    cmd.frequency = frequency;
+    cmd.deviation = deviation;
+
+    // data_to_send belongs to the RF task until it clears txbusy
+    txbusy = true;
+    if (!rfSend(&cmd)) {
+      txbusy = false;
+      request->send(503, "text/plain", "Radio busy, try again");
+      return;
     }
-
-    ELECHOUSE_cc1101.setSidle();
-    request->send(200, "text/plain", "Signal has been transmitted");
+    request->send(200, "text/plain", "Signal queued for transmission");
 });
 
 
@@ -667,28 +2347,25 @@ void setup() {
       return;
     }
 
-    int moduleIndex = (tmp_module == "1") ? 0 : 1;
-    int tx_pin = (tmp_module == "1") ? tx_pin1 : tx_pin2;
-
-    pinMode(tx_pin, OUTPUT);
-    ELECHOUSE_cc1101.setModul(moduleIndex);
-    ELECHOUSE_cc1101.Init();
-    ELECHOUSE_cc1101.setModulation(2);
-    ELECHOUSE_cc1101.setMHZ(frequency);
-    ELECHOUSE_cc1101.setPA(power_jammer);
-    ELECHOUSE_cc1101.SetTx();
+    RfCommand cmd;
+    cmd.type = RF_JAMMER_START;
+    cmd.module = (tmp_module == "1") ? 0 : 1;
+    cmd.frequency = frequency;
+    cmd.power = power_jammer;
 
-    jammer_tx = "1";
+    if (!rfSend(&cmd)) {
+      request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Radio busy, try again\"}");
+      return;
+    }
     request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Jammer started\"}");
   });
 
   controlserver.on("/stopjammer", HTTP_POST, [](AsyncWebServerRequest *request) {
-    ELECHOUSE_cc1101.setModul(0);
-    ELECHOUSE_cc1101.setSidle();
-    ELECHOUSE_cc1101.setModul(1);
-    ELECHOUSE_cc1101.setSidle();
+    RfCommand cmd;
+    cmd.type = RF_JAMMER_STOP;
+    cmd.module = 0;
+    rfSend(&cmd);
 
-    jammer_tx = "0";
     request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Jammer stopped\"}");
   });
 
@@ -696,38 +2373,199 @@ void setup() {
     request->send(SD, "/HTML/style.css", "text/css");
   });
 
-  controlserver.begin();
   ELECHOUSE_cc1101.addSpiPin(sck_pin, miso_pin, mosi_pin, cs_pin1, 0);
   ELECHOUSE_cc1101.addSpiPin(sck_pin, miso_pin, mosi_pin, cs_pin2, 1);
-  
-  enableReceive();
+
+  rxInit(&rxctx[0], 0, rx_pin1, tx_pin1);
+  rxInit(&rxctx[1], 1, rx_pin2, tx_pin2);
+
+  rfQueue = xQueueCreate(RF_QUEUE_LEN, sizeof(RfCommand));
+  storageQueue = xQueueCreate(STORAGE_QUEUE_LEN, sizeof(StorageItem));
+  storageDone = xSemaphoreCreateBinary();
+  bootid = esp_random();
+  chunkQueue = xQueueCreate(LOG_CHUNKS, sizeof(char *));
+  for (int i = 0; i < LOG_CHUNKS; i++) {
+    char *chunk = logChunks[i];
+    xQueueSend(chunkQueue, &chunk, 0);
+  }
+  logInit(&rxlog, LOG_CHUNK_SIZE, logChunk, (void *)LOG_PATH);
+  ecapQueue = xQueueCreate(ECAP_BUFFERS, sizeof(char *));
+  xTaskCreatePinnedToCore(rfTask, "rf", RF_TASK_STACK, NULL, 2, &rfTaskHandle, RF_CORE);
+  xTaskCreatePinnedToCore(storageTask, "storage", STORAGE_TASK_STACK, NULL, 1, &storagestats.handle, STORAGE_CORE);
+  rfstats.handle = rfTaskHandle;
+
+  controlserver.begin();
 }
 
-void loop() {
-  if(raw_rx == "1") {
-    if(checkReceived()){
-      printReceived();
-      signalanalyse();
-      enableReceive();
-      delay(700);
+// Queues a command for the RF task, false when the queue is full.
+bool rfSend(RfCommand *cmd) {
+  if (xQueueSend(rfQueue, cmd, 0) != pdPASS) {
+    return false;
+  }
+  xTaskNotifyGive(rfTaskHandle);
+  return true;
+}
+
+// Applies the radio settings of rx->cfg to its module.
+void rxConfigure(RxContext *rx) {
+  ELECHOUSE_cc1101.setModul(rx->module);
+  ELECHOUSE_cc1101.Init();
+
+  if (rx->cfg.mod == 2) {
+    ELECHOUSE_cc1101.setDcFilterOff(0);
+  } else if (rx->cfg.mod == 0) {
+    ELECHOUSE_cc1101.setDcFilterOff(1);
+    ELECHOUSE_cc1101.setDeviation(rx->cfg.deviation);
+  }
+
+  ELECHOUSE_cc1101.setModulation(rx->cfg.mod);
+  ELECHOUSE_cc1101.setMHZ(rx->cfg.frequency);
+  ELECHOUSE_cc1101.setSyncMode(0);
+  ELECHOUSE_cc1101.setPktFormat(3);
+  ELECHOUSE_cc1101.setRxBW(rx->cfg.setrxbw);
+  ELECHOUSE_cc1101.setDRate(rx->cfg.datarate);
+}
+
+void transmitRaw(RfCommand *cmd) {
+  int tx_pin = cmd->module == 0 ? tx_pin1 : tx_pin2;
+
+  ELECHOUSE_cc1101.setModul(cmd->module);
+  ELECHOUSE_cc1101.Init();
+  ELECHOUSE_cc1101.setModulation(cmd->mod);
+  ELECHOUSE_cc1101.setMHZ(cmd->frequency);
+  ELECHOUSE_cc1101.setDeviation(cmd->deviation);
+  ELECHOUSE_cc1101.SetTx();
+  pinMode(tx_pin, OUTPUT);
+
+  PulseReader rd;
+  uint32_t pulse;
+  pulseReaderInit(&rd, data_to_send, txlen);
+  while (pulseNext(&rd, &pulse)) {
+    digitalWrite(tx_pin, PULSE_LEVEL(pulse) ? HIGH : LOW);
+    delayMicroseconds(PULSE_TIME(pulse));
+  }
+  digitalWrite(tx_pin, LOW);
+
+  ELECHOUSE_cc1101.setSidle();
+}
+
+void jammerStart(RfCommand *cmd) {
+  pinMode(cmd->module == 0 ? tx_pin1 : tx_pin2, OUTPUT);
+  ELECHOUSE_cc1101.setModul(cmd->module);
+  ELECHOUSE_cc1101.Init();
+  ELECHOUSE_cc1101.setModulation(2);
+  ELECHOUSE_cc1101.setMHZ(cmd->frequency);
+  ELECHOUSE_cc1101.setPA(cmd->power);
+  ELECHOUSE_cc1101.SetTx();
+  jammerModule = cmd->module;
+}
+
+void jammerStop() {
+  if (jammerModule >= 0) {
+    ELECHOUSE_cc1101.setModul(jammerModule);
+    ELECHOUSE_cc1101.setSidle();
+  }
+  jammerModule = -1;
+}
+
+// Sends the jammer pattern for JAMMER_BURST_MS at a time so the RF task can
+// still take commands and serve the other module in between.
+void jammerBurst() {
+  int tx_pin = jammerModule == 0 ? tx_pin1 : tx_pin2;
+  unsigned long start = millis();
+
+  while (millis() - start < JAMMER_BURST_MS) {
+    for (int i = 0; i + 1 < jammer_len; i += 2) {
+      digitalWrite(tx_pin, HIGH);
+      delayMicroseconds(jammer[i]);
+      digitalWrite(tx_pin, LOW);
+      delayMicroseconds(jammer[i + 1]);
     }
   }
-  if(jammer_tx == "1") {
-    if (tmp_module == "1") {
-      for (int i = 0; i + 1 < jammer_len; i += 2){
-        digitalWrite(tx_pin1,HIGH);
-        delayMicroseconds(jammer[i]);
-        digitalWrite(tx_pin1,LOW);
-        delayMicroseconds(jammer[i+1]);
-      }
+}
+
+void rfCommand(RfCommand *cmd) {
+  RxContext *rx = &rxctx[cmd->module];
+
+  // Any other use of the jamming module ends the jammer
+  if (cmd->module == jammerModule || cmd->type == RF_JAMMER_STOP) {
+    jammerStop();
+  }
+
+  switch (cmd->type) {
+    case RF_RX_START:
+      disableReceive(rx);
+      rx->cfg = cmd->rx;
+      rxConfigure(rx);
+      enableReceive(rx);
+      break;
+    case RF_RX_STOP:
+      disableReceive(rx);
+      break;
+    case RF_TX_RAW:
+      disableReceive(rx);
+      transmitRaw(cmd);
+      txbusy = false;
+      break;
+    case RF_JAMMER_START:
+      disableReceive(rx);
+      jammerStart(cmd);
+      break;
+    case RF_JAMMER_STOP:
+      break;
+  }
+  ecapPoolUpdate();
+}
+
+// Consumer of both capture rings. It sleeps until an interrupt reports a
+// frame boundary or until the current frame would end by silence.
+void rfTask(void *arg) {
+  RfCommand cmd;
+
+  rfstats.since = micros();
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    unsigned long start = micros();
+
+    while (xQueueReceive(rfQueue, &cmd, 0) == pdPASS) {
+      rfCommand(&cmd);
     }
-    else if (tmp_module == "2") {
-      for (int i = 0; i + 1 < jammer_len; i += 2){
-        digitalWrite(tx_pin2,HIGH);
-        delayMicroseconds(jammer[i]);
-        digitalWrite(tx_pin2,LOW);
-        delayMicroseconds(jammer[i+1]);
+
+    for (int i = 0; i < 2; i++) {
+      RxContext *rx = &rxctx[i];
+      if (!rx->active) {
+        continue;
+      }
+      if (checkReceived(rx)) {
+        rxLatency(rx);
+        printReceived(rx);
+        signalanalyse(rx);
+        captureStore(rx);
+        if (rx->cfg.ecap) {
+          ecapStore(rx);
+        }
+        frameDone(rx);
+        // The next frame may already be queued
+        wait = 0;
+        continue;
       }
+      TickType_t ticks = rxWait(rx);
+      if (ticks < wait) {
+        wait = ticks;
+      }
+    }
+
+    if (jammerModule >= 0) {
+      jammerBurst();
+      // One tick of sleep lets lower priority tasks on this core run
+      wait = 1;
     }
+    taskBusy(&rfstats, start);
+    ulTaskNotifyTake(pdTRUE, wait);
   }
-}
\ No newline at end of file
+}
+
+// All work is done by the RF and storage tasks and the web server
+void loop() {
+  vTaskDelete(NULL);
+}
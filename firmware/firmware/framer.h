@@ -0,0 +1,66 @@
+/*
+  framer.h - Frame assembly from the edge ring
+
+  The RF task pops pulses from the ring of edgering.h into a frame buffer in
+  the encoding of pulses.h. A frame start that arrives while a frame is open
+  ends that frame before it: the pulse is held and fed again once the frame
+  has been processed, so it starts the next one. A frame also ends when its
+  buffer could not take another escaped pulse. framePulse() in firmware.ino
+  decides on every pulse with the triggers, post-trigger count and minimum
+  frame length on top; the host tests feed the same loop.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef FRAMER_h
+#define FRAMER_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pulses.h"
+#include "edgering.h"
+
+// What a pulse did to the frame, see FramePulse
+#define FRAME_OPEN        0             // taken, the frame goes on
+#define FRAME_ENDED       1             // taken, and it completed the frame
+#define FRAME_SPLIT       2             // the frame ended before it, the pulse is held for the next one
+
+// Consumer of one pulse, returns FRAME_*.
+typedef int (*FramePulse)(void *ctx, uint32_t pulse);
+
+// True when pulse is a frame start that ends an open frame of count pulses.
+static inline bool frameSplits(uint32_t pulse, int count) {
+  return (pulse & EDGE_FRAME_START) && count > 0;
+}
+
+// Appends a pulse to a frame of size words holding len words and count
+// pulses. Returns true when the frame is full: one more escaped pulse would
+// not fit.
+static inline bool frameAppend(uint16_t *words, size_t size, size_t *len, int *count, uint32_t pulse) {
+  pulseAppend(words, len, size, pulse);
+  (*count)++;
+  return *len + PULSE_MAX_WORDS > size;
+}
+
+// Feeds the held pulse, then the pulses of the ring, to pulse() until it
+// completes a frame. Returns true when it did; the ring may still hold the
+// pulses of the next frames.
+static inline bool frameFill(EdgeRing *ring, uint32_t *held, FramePulse pulse, void *ctx) {
+  uint32_t p;
+  int state = FRAME_OPEN;
+
+  if (*held) {
+    p = *held;
+    *held = 0;
+    state = pulse(ctx, p);
+  }
+  while (state == FRAME_OPEN && ringPop(ring, &p)) {
+    state = pulse(ctx, p);
+  }
+  if (state == FRAME_SPLIT) {
+    *held = p;
+  }
+  return state != FRAME_OPEN;
+}
+
+#endif
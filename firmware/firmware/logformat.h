@@ -0,0 +1,139 @@
+/*
+  logformat.h - Log text formatting without heap allocation
+
+  A LogBuffer formats straight into a fixed buffer and hands it to a sink
+  when it fills up or is flushed; the sink returns the buffer to continue
+  in, which may be the same one or another from a pool. Numbers are
+  converted two digits at a time from a table instead of going through
+  String or printf.
+
+  When the sink has no buffer to give, text is counted in dropped and
+  discarded until the next flush gets one.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef LOGFORMAT_h
+#define LOGFORMAT_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Takes len bytes of text in buf, NULL when only a buffer is wanted, and
+// returns the buffer to write on in, or NULL when there is none.
+typedef char *(*LogSink)(void *ctx, char *buf, size_t len);
+
+typedef struct {
+  char *buf;
+  size_t size;
+  size_t len;
+  LogSink sink;
+  void *ctx;
+  uint32_t dropped;                     // bytes lost for want of a buffer
+} LogBuffer;
+
+static const char logDigits[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline void logInit(LogBuffer *l, size_t size, LogSink sink, void *ctx) {
+  l->size = size;
+  l->len = 0;
+  l->sink = sink;
+  l->ctx = ctx;
+  l->dropped = 0;
+  l->buf = sink(ctx, NULL, 0);
+}
+
+// Hands the text written so far to the sink.
+static inline void logFlush(LogBuffer *l) {
+  if (l->buf == NULL) {
+    l->buf = l->sink(l->ctx, NULL, 0);
+  } else if (l->len > 0) {
+    l->buf = l->sink(l->ctx, l->buf, l->len);
+  }
+  l->len = 0;
+}
+
+static inline void logWrite(LogBuffer *l, const char *text, size_t n) {
+  while (n > 0) {
+    if (l->buf == NULL) {
+      l->dropped += n;
+      return;
+    }
+    size_t room = l->size - l->len;
+    size_t part = n < room ? n : room;
+    memcpy(l->buf + l->len, text, part);
+    l->len += part;
+    text += part;
+    n -= part;
+    if (l->len == l->size) {
+      logFlush(l);
+    }
+  }
+}
+
+static inline void logStr(LogBuffer *l, const char *text) {
+  logWrite(l, text, strlen(text));
+}
+
+static inline void logChar(LogBuffer *l, char c) {
+  if (l->buf != NULL && l->len + 1 < l->size) {
+    l->buf[l->len++] = c;
+  } else {
+    logWrite(l, &c, 1);
+  }
+}
+
+static inline void logUint(LogBuffer *l, uint32_t v) {
+  char tmp[10];
+  char *p = tmp + sizeof(tmp);
+
+  while (v >= 100) {
+    uint32_t q = v / 100;
+    p -= 2;
+    memcpy(p, logDigits + (v - q * 100) * 2, 2);
+    v = q;
+  }
+  if (v >= 10) {
+    p -= 2;
+    memcpy(p, logDigits + v * 2, 2);
+  } else {
+    *--p = '0' + v;
+  }
+  logWrite(l, p, tmp + sizeof(tmp) - p);
+}
+
+static inline void logInt(LogBuffer *l, int32_t v) {
+  if (v < 0) {
+    logChar(l, '-');
+    logUint(l, 0 - (uint32_t)v);
+  } else {
+    logUint(l, v);
+  }
+}
+
+// Writes v rounded to a fixed number of decimals, like String(v, decimals).
+static inline void logFixed(LogBuffer *l, float v, int decimals) {
+  uint32_t scale = 1;
+  for (int d = 0; d < decimals; d++) {
+    scale *= 10;
+  }
+  if (v < 0) {
+    logChar(l, '-');
+    v = -v;
+  }
+  uint64_t x = (uint64_t)(v * scale + 0.5f);
+  logUint(l, x / scale);
+  if (decimals > 0) {
+    uint32_t frac = x % scale;
+    logChar(l, '.');
+    for (uint32_t s = scale / 10; s > 1 && frac < s; s /= 10) {
+      logChar(l, '0');
+    }
+    logUint(l, frac);
+  }
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+  pulses.h - Pulse records and their compact 16-bit encoding
+
+  A pulse record is a 32-bit value with the level of the period in bit 31,
+  the frame start flag in bit 30 and the period length in us in bits 0-29.
+
+  Stored pulses use one 16-bit word, level in bit 15 and the duration in
+  bits 0-14, for anything shorter than 32767us. Longer periods and frame
+  starts use an escape word (level | 0x7FFF) followed by two words holding
+  the frame start flag in bit 15 of the first one and the 30-bit duration.
+  Nearly all pulses fit one word, so a buffer of N words holds close to N
+  pulses instead of N / 2 with unsigned long samples.
+
+  ringPush() encodes in the receive interrupt, so pulseEncode() and
+  pulseAppend() are forced inline and, where they stay functions, kept in
+  IRAM, where the handler can run while the flash cache is off.
+
+  No Arduino dependency, this file is shared with the host tools.
+*/
+#ifndef PULSES_h
+#define PULSES_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+#define PULSE_HIGH        0x80000000UL
+#define EDGE_FRAME_START  0x40000000UL
+#define PULSE_DURATION    0x3FFFFFFFUL
+#define PULSE(level, duration) (((level) ? PULSE_HIGH : 0) | ((duration) > PULSE_DURATION ? PULSE_DURATION : (duration)))
+#define PULSE_LEVEL(p)    (((p) & PULSE_HIGH) != 0)
+#define PULSE_TIME(p)     ((p) & PULSE_DURATION)
+#define PULSE_EXTEND(p, d) (((p) & ~PULSE_DURATION) | PULSE_TIME(PULSE(0, PULSE_TIME(p) + (d))))
+
+#define PULSE_ESCAPE      0x7FFF
+#define PULSE_MAX_WORDS   3             // longest encoding of one pulse
+
+// Encodes one pulse record into out, returns the number of words used.
+static inline __attribute__((always_inline)) size_t IRAM_ATTR pulseEncode(uint32_t pulse, uint16_t *out) {
+  uint16_t level = PULSE_LEVEL(pulse) ? 0x8000 : 0;
+  uint32_t duration = PULSE_TIME(pulse);
+
+  if (duration < PULSE_ESCAPE && !(pulse & EDGE_FRAME_START)) {
+    out[0] = level | duration;
+    return 1;
+  }
+  out[0] = level | PULSE_ESCAPE;
+  out[1] = (pulse & EDGE_FRAME_START ? 0x8000 : 0) | (duration >> 16);
+  out[2] = duration & 0xFFFF;
+  return 3;
+}
+
+// Decodes one pulse record from in, returns the number of words consumed
+// or 0 when fewer than the needed words are available.
+static inline size_t pulseDecode(const uint16_t *in, size_t avail, uint32_t *pulse) {
+  if (avail == 0) {
+    return 0;
+  }
+
+  uint32_t level = in[0] & 0x8000 ? PULSE_HIGH : 0;
+
+  if ((in[0] & 0x7FFF) != PULSE_ESCAPE) {
+    *pulse = level | (in[0] & 0x7FFF);
+    return 1;
+  }
+  if (avail < 3) {
+    return 0;
+  }
+  *pulse = level | (in[1] & 0x8000 ? EDGE_FRAME_START : 0) | ((uint32_t)(in[1] & 0x3FFF) << 16) | in[2];
+  return 3;
+}
+
+// Appends one pulse to a word buffer, returns false when it does not fit.
+static inline __attribute__((always_inline)) bool IRAM_ATTR pulseAppend(uint16_t *words, size_t *len, size_t max, uint32_t pulse) {
+  uint16_t enc[PULSE_MAX_WORDS];
+  size_t n = pulseEncode(pulse, enc);
+
+  if (*len + n > max) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    words[(*len)++] = enc[i];
+  }
+  return true;
+}
+
+// Sequential reader over an encoded pulse buffer.
+typedef struct {
+  const uint16_t *words;
+  size_t len;
+  size_t pos;
+} PulseReader;
+
+static inline void pulseReaderInit(PulseReader *rd, const uint16_t *words, size_t len) {
+  rd->words = words;
+  rd->len = len;
+  rd->pos = 0;
+}
+
+static inline bool pulseNext(PulseReader *rd, uint32_t *pulse) {
+  size_t n = pulseDecode(rd->words + rd->pos, rd->len - rd->pos, pulse);
+  rd->pos += n;
+  return n > 0;
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  tasks.h - Messages between the web server, RF and storage tasks
+
+  The RF task owns both CC1101 modules: every radio access, capture and
+  transmission runs there. Web handlers only validate their arguments and
+  queue an RfCommand. Log text leaves the RF task as StorageItems so a slow
+  SD card never holds up capture processing. The log buffers come from a
+  fixed pool that circulates between the two tasks, so logging a capture
+  allocates nothing. A record of captures.ecap is built whole in a buffer
+  of a second pool, allocated only while a module stores captures, and
+  queued as one item, or dropped whole when there is no room, so the file
+  never holds a torn record for want of a buffer. The storage task notes
+  the offset of every record in captures.idx. It keeps the files open,
+  each with a write-behind buffer, writing whole buffers and syncing once
+  a second or when the web server reads a file; the web server does not
+  wait for that sync and serves what the card already holds. The log is a
+  series of numbered segment files of about LOG_SEGMENT_SIZE, the oldest
+  deleted as new ones start, so the web server reads it a page at a time
+  however long it runs.
+*/
+#ifndef TASKS_h
+#define TASKS_h
+
+#include <Arduino.h>
+#include <FS.h>
+#include "capture.h"
+
+#define RF_CORE           1             // the Arduino loop task deletes itself, the core is the RF task's
+#define STORAGE_CORE      0             // WiFi and the web server run here too
+#define RF_QUEUE_LEN      8
+#define STORAGE_QUEUE_LEN 32
+#define LOG_CHUNKS        8             // log buffers shared by the RF and storage tasks
+#define LOG_CHUNK_SIZE    1024
+#define STORAGE_WAIT_MS   20            // RF task wait for a free log buffer
+#define STORAGE_BUFFER    4096          // write-behind buffer, whole SD sectors
+#define STORAGE_INDEX_BUFFER 64         // write-behind buffer of captures.idx, 16 offsets
+#define STORAGE_FLUSH_MS  1000          // longest time text waits before it is written and synced
+#define STORAGE_DELETE_WAIT_MS 1000     // web server wait for a delete
+#define ECAP_PATH         "/captures.ecap"
+#define ECAP_INDEX_PATH   "/captures.idx"    // u32 offset of every record of captures.ecap
+#define ECAP_BUFFERS      1             // capture record buffers, a whole frame each, on the heap
+#define LOG_PATH          "/logs.txt"   // the current log segment, for StorageItems
+#define LOG_DIR           "/logs"
+#define LOG_INDEX         "/logs/index.txt"  // numbers of the oldest and newest segment
+#define LOG_SEGMENT_SIZE  262144        // a segment ends at the next capture after this
+#define LOG_SEGMENT_SLACK 65536         // or here in the middle of one
+#define LOG_SEGMENTS      64            // oldest segments are deleted beyond this
+#define LOG_PAGE          16384         // longest /logs response
+#define STORAGE_FILES     3             // files kept open at once, the text log, captures.ecap and its index
+
+typedef enum {
+  RF_RX_START,                          // apply rx and start receiving on module
+  RF_RX_STOP,
+  RF_TX_RAW,                            // send data_to_send on module
+  RF_JAMMER_START,
+  RF_JAMMER_STOP                        // stops the jammer on both modules
+} RfCommandType;
+
+typedef struct {
+  RfCommandType type;
+  int module;                           // 0 = module 1, 1 = module 2
+  RxConfig rx;                          // RF_RX_START
+  int mod;                              // RF_TX_RAW
+  float frequency;                      // RF_TX_RAW, RF_JAMMER_START
+  float deviation;                      // RF_TX_RAW
+  int power;                            // RF_JAMMER_START
+} RfCommand;
+
+typedef enum {
+  STORAGE_APPEND,                       // append text to path
+  STORAGE_SYNC,                         // write out everything buffered and sync the file
+  STORAGE_DELETE                        // drop buffered text and remove path
+} StorageOp;
+
+// Work for the storage task. For STORAGE_APPEND text holds len bytes in a
+// buffer of pool, handed back once copied; STORAGE_DELETE signals
+// storageDone, nobody waits for STORAGE_SYNC.
+typedef struct {
+  StorageOp op;
+  const char *path;
+  char *text;
+  size_t len;
+  QueueHandle_t pool;                   // free buffers text goes back to
+  bool start;                           // text opens a capture, the log may start a new segment here
+} StorageItem;
+
+// A file the storage task keeps open, with its write-behind buffer. The
+// last slot has the small buffer and only takes captures.idx.
+typedef struct {
+  const char *path;                     // NULL = slot unused
+  File file;
+  char *buf;
+  size_t size;                          // STORAGE_BUFFER or STORAGE_INDEX_BUFFER
+  size_t len;
+  bool dirty;                           // written since the last sync
+} StorageFile;
+
+// Busy time and stack headroom of one task, see /stats.
+typedef struct {
+  const char *name;
+  TaskHandle_t handle;
+  uint32_t busy;                        // us spent working since the last report
+  unsigned long since;                  // start of the report interval
+} TaskStats;
+
+static inline void taskBusy(TaskStats *t, unsigned long start) {
+  t->busy += micros() - start;
+}
+
+#endif
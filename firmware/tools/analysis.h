@@ -0,0 +1,163 @@
+/*
+  analysis.h - The analysis of the firmware, run over one capture
+
+  Pulse clustering, symbol quantization, repeat voting, line code
+  classification and the fixed code decoders come from the same headers as
+  on the device, so a capture analysed here gives the same result as
+  signalanalyse() and /messages.
+*/
+#ifndef ANALYSIS_h
+#define ANALYSIS_h
+
+#include <stdio.h>
+#include <string>
+
+#include "pulses.h"
+#include "analyzer.h"
+#include "decoders.h"
+#include "correlator.h"
+#include "captures.h"
+
+#define SAMPLE_WORDS      4000          // samplewords in capture.h
+#define DEFAULT_TOLERANCE 200           // error_toleranz in firmware.ino
+#define SYNC_MATCHES      4             // matches per frame, as on the device
+
+typedef struct {
+  int tolerance;
+  BitPattern preamble;
+  BitPattern sync;
+  int syncerrors;
+} AnalysisOptions;
+
+typedef struct {
+  bool valid;
+  uint32_t symbol;
+  int classes;
+  int messages;
+  int repeats;
+  int rejected;
+  std::string vote;
+  int confidence;                       // lowest per bit confidence of the vote
+  LineCode line;
+  Decoded decoded;
+  int decodes;                          // messages with the code received most often
+  std::string preambles;                // frame:bit/errors, as the log shows them
+  std::string syncs;
+} Result;
+
+static inline void frameSearch(const FrameVote *vote, int frame, const BitPattern *p, int maxerrors, std::string *line) {
+  BitMatch match[SYNC_MATCHES];
+  int n = patternSearch(vote->cur, vote->curbits, 0, p, maxerrors, match, SYNC_MATCHES);
+
+  for (int i = 0; i < n; i++) {
+    char text[40];
+    snprintf(text, sizeof(text), "%s%d:%d/%d", line->empty() ? "" : " ", frame, match[i].offset, match[i].errors);
+    *line += text;
+  }
+}
+
+typedef struct {
+  const AnalysisOptions *o;
+  Result *r;
+} RepeatSearch;
+
+// Pattern search of every repeat, as frameHits() does on the device.
+static inline void repeatSearch(void *ctx, const FrameVote *vote, int frame) {
+  RepeatSearch *s = (RepeatSearch *)ctx;
+
+  frameSearch(vote, frame, &s->o->preamble, s->o->syncerrors, &s->r->preambles);
+  frameSearch(vote, frame, &s->o->sync, s->o->syncerrors, &s->r->syncs);
+}
+
+// The analysis of signalanalyse() and the stream analyzer of the RF task.
+static inline void analyzeCapture(const AnalysisOptions *o, const Capture *c, Result *r) {
+  static thread_local uint16_t sample[SAMPLE_WORDS];
+  static thread_local StreamAnalyzer stream;
+  static thread_local FrameVote vote;
+  static thread_local CodeTally codes;
+  static thread_local LineTally lines;
+  size_t samplelen = 0;
+
+  r->valid = false;
+  r->messages = 0;
+  r->decodes = 0;
+  r->decoded.protocol = NULL;
+  r->line.nbits = 0;
+  r->line.score = 0;
+  for (size_t i = 0; i < c->pulses.size(); i++) {
+    if (!pulseAppend(sample, &samplelen, SAMPLE_WORDS, c->pulses[i])) {
+      break;
+    }
+  }
+
+  // Messages as the RF task sees them while the frame arrives, without the
+  // lead-in gap
+  streamReset(&stream, o->tolerance);
+  codeTallyReset(&codes);
+  lineTallyReset(&lines);
+  for (size_t i = 1; i <= c->pulses.size(); i++) {
+    bool done = i < c->pulses.size() ? streamPulse(&stream, c->pulses[i]) : streamIdle(&stream);
+    if (!done) {
+      continue;
+    }
+    Decoded d;
+    LineCode line;
+    r->messages++;
+    if (decodeMessage(stream.pulses, stream.count, &d)) {
+      codeTallyAdd(&codes, &d);
+    }
+    lineDecode(stream.pulses, stream.count, streamUnit(&stream), &line);
+    lineTallyAdd(&lines, &line);
+  }
+  const Decoded *best = codeTallyBest(&codes, &r->decodes);
+  if (best != NULL) {
+    r->decoded = *best;
+  }
+  int linerepeats;
+  const LineCode *bestline = lineTallyBest(&lines, &linerepeats);
+  if (bestline != NULL) {
+    r->line = *bestline;
+  }
+
+  SymbolQuantizer q;
+  RepeatSearch search = { o, r };
+  FrameResult frame;
+  r->preambles.clear();
+  r->syncs.clear();
+  frameAnalyse(sample, samplelen, o->tolerance, &q, &vote, repeatSearch, &search, &frame);
+  if (frame.symbol == 0) {
+    return;
+  }
+  r->valid = true;
+  r->symbol = frame.symbol;
+  r->classes = frame.classes;
+
+  int nbits = voteLength(&vote);
+  r->repeats = vote.repeats;
+  r->rejected = vote.rejected;
+  r->confidence = nbits ? 100 : 0;
+  r->vote.clear();
+  for (int i = 0; i < nbits; i++) {
+    int conf = voteConfidence(&vote, i);
+    r->vote += voteMajority(&vote, i) ? '1' : '0';
+    if (conf < r->confidence) {
+      r->confidence = conf;
+    }
+  }
+}
+
+// The decoded block of an .ecap record for a result, as ecapStore() fills it.
+static inline void resultDecoded(const Result *r, EcapDecoded *dec) {
+  memset(dec, 0, sizeof(*dec));
+  if (r->decoded.protocol != NULL) {
+    strncpy(dec->protocol, r->decoded.protocol->name, ECAP_NAME_SIZE - 1);
+    dec->code = r->decoded.code;
+    dec->bits = r->decoded.bits;
+    dec->te = r->decoded.te < 0xFFFF ? r->decoded.te : 0xFFFF;
+  }
+  dec->linecode = r->line.nbits > 0 ? r->line.code : ECAP_NO_LINE;
+  dec->linebits = r->line.nbits;
+  memcpy(dec->payload, r->line.bits, ECAP_PAYLOAD_SIZE);
+}
+
+#endif
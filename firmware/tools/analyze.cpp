@@ -0,0 +1,292 @@
+/*
+  analyze - Offline analysis of captures from /logs.txt or captures.ecap
+
+  Runs the analysis of the firmware (analysis.h) over every capture found
+  in the files given on the command line, text logs and .ecap files alike.
+
+  Files are spread over a pool of worker threads. A worker splits its file
+  into captures and queues them on its own deque; idle workers steal from
+  the other end of the other deques, so one large log does not keep a
+  single core busy while the others wait.
+
+  Usage: analyze [-j threads] [-f csv|json] [-t tolerance]
+                 [-p preamble] [-s sync] [-e errors] [-q] log...
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "analysis.h"
+#include "captures.h"
+
+typedef struct {
+  const char *path;
+  std::vector<Capture> captures;
+  std::vector<Result> results;
+} LogFile;
+
+typedef struct {
+  LogFile *file;
+  int capture;                          // -1 = split the file into captures
+} Task;
+
+typedef struct {
+  std::mutex lock;
+  std::deque<Task> tasks;
+  uint64_t captures;
+  uint64_t pulses;
+  uint64_t stolen;
+  double busy;                          // seconds spent on tasks
+} Worker;
+
+static AnalysisOptions options = { DEFAULT_TOLERANCE, { 0, 0 }, { 0, 0 }, 0 };
+static std::atomic<int> pending;
+
+static bool popTask(Worker *workers, int count, int self, Task *t) {
+  Worker *w = &workers[self];
+  {
+    std::lock_guard<std::mutex> g(w->lock);
+    if (!w->tasks.empty()) {
+      *t = w->tasks.back();
+      w->tasks.pop_back();
+      return true;
+    }
+  }
+  for (int k = 1; k < count; k++) {
+    Worker *v = &workers[(self + k) % count];
+    std::lock_guard<std::mutex> g(v->lock);
+    if (!v->tasks.empty()) {
+      *t = v->tasks.front();
+      v->tasks.pop_front();
+      w->stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void workerRun(Worker *workers, int count, int self) {
+  Worker *w = &workers[self];
+  Task t;
+
+  while (pending.load() > 0) {
+    if (!popTask(workers, count, self, &t)) {
+      std::this_thread::yield();
+      continue;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (t.capture < 0) {
+      if (loadCaptures(t.file->path, &t.file->captures)) {
+        int n = t.file->captures.size();
+        t.file->results.resize(n);
+        pending += n;
+        std::lock_guard<std::mutex> g(w->lock);
+        for (int i = 0; i < n; i++) {
+          w->tasks.push_back({ t.file, i });
+        }
+      }
+    } else {
+      const Capture *c = &t.file->captures[t.capture];
+      analyzeCapture(&options, c, &t.file->results[t.capture]);
+      w->captures++;
+      w->pulses += c->pulses.size();
+    }
+    w->busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    pending--;
+  }
+}
+
+static void printCsv(const std::vector<LogFile> &files) {
+  printf("file,line,module,frequency,mod,rssi,pulses,symbol,classes,messages,repeats,rejected,confidence,vote,"
+         "encoding,score,payloadbits,payload,protocol,code,codebits,te,decodes,preamble,sync\n");
+  for (const LogFile &f : files) {
+    for (size_t i = 0; i < f.captures.size(); i++) {
+      const Capture *c = &f.captures[i];
+      const Result *r = &f.results[i];
+      char payload[LINE_BITS / 4 + 1] = "";
+      char code[33] = "";
+
+      if (r->line.nbits) {
+        lineHex(&r->line, payload, sizeof(payload));
+      }
+      if (r->decoded.protocol) {
+        decodedCode(&r->decoded, code, sizeof(code));
+      }
+      printf("%s,%d,%d,%s,%d,%d,%zu,", f.path, c->line, c->module, c->frequency.c_str(), c->mod, c->rssi, c->pulses.size());
+      if (!r->valid) {
+        printf(",,,,,,,,,,,,,,,,,\n");
+        continue;
+      }
+      printf("%u,%d,%d,%d,%d,%d,%s,", r->symbol, r->classes, r->messages, r->repeats, r->rejected, r->confidence, r->vote.c_str());
+      if (r->line.nbits) {
+        printf("%s,%d,%d,%s,", lineNames[r->line.code], r->line.score, r->line.nbits, payload);
+      } else {
+        printf(",,,,");
+      }
+      if (r->decoded.protocol) {
+        printf("%s,%s,%d,%u,%d,", r->decoded.protocol->name, code, r->decoded.bits, r->decoded.te, r->decodes);
+      } else {
+        printf(",,,,,");
+      }
+      printf("%s,%s\n", r->preambles.c_str(), r->syncs.c_str());
+    }
+  }
+}
+
+static void printJson(const std::vector<LogFile> &files) {
+  bool first = true;
+
+  printf("[");
+  for (const LogFile &f : files) {
+    for (size_t i = 0; i < f.captures.size(); i++) {
+      const Capture *c = &f.captures[i];
+      const Result *r = &f.results[i];
+
+      printf("%s\n{\"file\":\"", first ? "" : ",");
+      for (const char *p = f.path; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+          putchar('\\');
+        }
+        putchar(*p);
+      }
+      printf("\",\"line\":%d,\"module\":%d,\"frequency\":\"%s\",\"mod\":%d,\"rssi\":%d,\"pulses\":%zu",
+             c->line, c->module, c->frequency.c_str(), c->mod, c->rssi, c->pulses.size());
+      first = false;
+      if (!r->valid) {
+        printf("}");
+        continue;
+      }
+      printf(",\"symbol\":%u,\"classes\":%d,\"messages\":%d,\"repeats\":%d,\"rejected\":%d,\"confidence\":%d,\"vote\":\"%s\"",
+             r->symbol, r->classes, r->messages, r->repeats, r->rejected, r->confidence, r->vote.c_str());
+      if (r->line.nbits) {
+        char payload[LINE_BITS / 4 + 1];
+        lineHex(&r->line, payload, sizeof(payload));
+        printf(",\"encoding\":\"%s\",\"score\":%d,\"payloadbits\":%d,\"payload\":\"%s\"",
+               lineNames[r->line.code], r->line.score, r->line.nbits, payload);
+      }
+      if (r->decoded.protocol) {
+        char code[33];
+        decodedCode(&r->decoded, code, sizeof(code));
+        printf(",\"protocol\":\"%s\",\"code\":\"%s\",\"codebits\":%d,\"te\":%u,\"decodes\":%d",
+               r->decoded.protocol->name, code, r->decoded.bits, r->decoded.te, r->decodes);
+      }
+      if (options.preamble.len) {
+        printf(",\"preamble\":\"%s\"", r->preambles.c_str());
+      }
+      if (options.sync.len) {
+        printf(",\"sync\":\"%s\"", r->syncs.c_str());
+      }
+      printf("}");
+    }
+  }
+  printf("\n]\n");
+}
+
+static void usage() {
+  fprintf(stderr, "usage: analyze [-j threads] [-f csv|json] [-t tolerance]\n"
+                  "               [-p preamble] [-s sync] [-e errors] [-q] log...\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int threads = std::thread::hardware_concurrency();
+  bool json = false;
+  bool quiet = false;
+  std::vector<LogFile> files;
+
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-'; a++) {
+    if (strcmp(argv[a], "-j") == 0 && a + 1 < argc) {
+      threads = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc) {
+      a++;
+      if (strcmp(argv[a], "json") == 0) {
+        json = true;
+      } else if (strcmp(argv[a], "csv") != 0) {
+        usage();
+      }
+    } else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) {
+      options.tolerance = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "-p") == 0 && a + 1 < argc) {
+      if (!patternParse(argv[++a], &options.preamble)) {
+        usage();
+      }
+    } else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+      if (!patternParse(argv[++a], &options.sync)) {
+        usage();
+      }
+    } else if (strcmp(argv[a], "-e") == 0 && a + 1 < argc) {
+      options.syncerrors = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "-q") == 0) {
+      quiet = true;
+    } else {
+      usage();
+    }
+  }
+  if (a == argc) {
+    usage();
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  files.resize(argc - a);
+  for (int i = a; i < argc; i++) {
+    files[i - a].path = argv[i];
+  }
+
+  std::vector<Worker> workers(threads);
+  for (int i = 0; i < threads; i++) {
+    workers[i].captures = 0;
+    workers[i].pulses = 0;
+    workers[i].stolen = 0;
+    workers[i].busy = 0;
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    workers[i % threads].tasks.push_back({ &files[i], -1 });
+  }
+  pending = files.size();
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; i++) {
+    pool.emplace_back(workerRun, workers.data(), threads, i);
+  }
+  for (std::thread &t : pool) {
+    t.join();
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (json) {
+    printJson(files);
+  } else {
+    printCsv(files);
+  }
+
+  if (!quiet) {
+    uint64_t captures = 0;
+    uint64_t pulses = 0;
+    for (int i = 0; i < threads; i++) {
+      captures += workers[i].captures;
+      pulses += workers[i].pulses;
+    }
+    fprintf(stderr, "%zu files, %llu captures, %llu pulses in %.3f s with %d threads\n",
+            files.size(), (unsigned long long)captures, (unsigned long long)pulses, wall, threads);
+    if (wall > 0) {
+      fprintf(stderr, "%.0f captures/s, %.0f pulses/s\n", captures / wall, pulses / wall);
+    }
+    for (int i = 0; i < threads; i++) {
+      fprintf(stderr, "  worker %d: %llu captures, %llu stolen, %.0f%% busy\n", i,
+              (unsigned long long)workers[i].captures, (unsigned long long)workers[i].stolen,
+              wall > 0 ? workers[i].busy * 100 / wall : 0.0);
+    }
+  }
+  return 0;
+}
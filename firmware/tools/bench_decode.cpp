@@ -0,0 +1,94 @@
+/*
+  bench_decode - Throughput of the fixed code decoders and the line code
+  classifier
+
+  The captures are split into messages by the stream analyzer first, then
+  every message goes through decodeMessage(), lineDecode() and the per code
+  tallies as in streamMessage(), over and over for the given time. Without
+  files, a corpus of all five families is synthesized.
+
+  Usage: bench_decode [-s seconds] [file...]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "analysis.h"
+#include "synth.h"
+
+typedef struct {
+  std::vector<uint32_t> pulses;
+  uint32_t unit;
+} Message;
+
+static void splitMessages(const Capture *c, std::vector<Message> *out) {
+  static StreamAnalyzer stream;
+  streamReset(&stream, DEFAULT_TOLERANCE);
+  for (size_t i = 1; i <= c->pulses.size(); i++) {
+    bool done = i < c->pulses.size() ? streamPulse(&stream, c->pulses[i]) : streamIdle(&stream);
+    if (done) {
+      out->push_back({ std::vector<uint32_t>(stream.pulses, stream.pulses + stream.count), streamUnit(&stream) });
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  double seconds = 2;
+  int a = 1;
+
+  if (a + 1 < argc && strcmp(argv[a], "-s") == 0) {
+    seconds = atof(argv[a + 1]);
+    a += 2;
+  }
+
+  std::vector<Capture> captures;
+  for (; a < argc; a++) {
+    loadCaptures(argv[a], &captures);
+  }
+  if (captures.empty()) {
+    synthCorpus(&captures, 2000);
+  }
+
+  std::vector<Message> messages;
+  for (const Capture &c : captures) {
+    splitMessages(&c, &messages);
+  }
+  if (messages.empty()) {
+    fprintf(stderr, "no messages in %zu captures\n", captures.size());
+    return 1;
+  }
+
+  CodeTally codes;
+  LineTally lines;
+  uint64_t runs = 0;
+  uint64_t decoded = 0;
+  uint64_t linebits = 0;
+  auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  while (elapsed < seconds) {
+    codeTallyReset(&codes);
+    lineTallyReset(&lines);
+    for (const Message &m : messages) {
+      Decoded d;
+      LineCode line;
+      if (decodeMessage(m.pulses.data(), m.pulses.size(), &d)) {
+        codeTallyAdd(&codes, &d);
+        decoded++;
+      }
+      lineDecode(m.pulses.data(), m.pulses.size(), m.unit, &line);
+      lineTallyAdd(&lines, &line);
+      linebits += line.nbits;
+    }
+    runs++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  uint64_t total = runs * messages.size();
+  printf("%zu captures, %zu messages, %.1f%% decoded, %.1f line bits per message\n", captures.size(),
+         messages.size(), 100.0 * decoded / total, (double)linebits / total);
+  printf("%.0f messages/s, %.0f decodes/s, %.2f us per message\n", total / elapsed, decoded / elapsed,
+         elapsed * 1e6 / total);
+  return 0;
+}
@@ -0,0 +1,99 @@
+/*
+  bench_encode - Throughput and size of the 16-bit pulse encoding of
+  pulses.h
+
+  Every pulse of the captures is appended to a word buffer with
+  pulseAppend() as the capture interrupt path does, then read back with
+  pulseNext() as the analysis does, over and over for the given time. The
+  decoded pulses must match the originals. The size is compared with the
+  4-byte samples the encoding replaced. Without files, a corpus of all five
+  decoder families is synthesized.
+
+  Usage: bench_encode [-s seconds] [file...]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "analysis.h"
+#include "synth.h"
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char **argv) {
+  double seconds = 2;
+  int a = 1;
+
+  if (a + 1 < argc && strcmp(argv[a], "-s") == 0) {
+    seconds = atof(argv[a + 1]);
+    a += 2;
+  }
+
+  std::vector<Capture> captures;
+  for (; a < argc; a++) {
+    loadCaptures(argv[a], &captures);
+  }
+  if (captures.empty()) {
+    synthCorpus(&captures, 2000);
+  }
+
+  std::vector<uint32_t> pulses;
+  for (const Capture &c : captures) {
+    pulses.insert(pulses.end(), c.pulses.begin(), c.pulses.end());
+  }
+  if (pulses.empty()) {
+    fprintf(stderr, "no pulses in %zu captures\n", captures.size());
+    return 1;
+  }
+  std::vector<uint16_t> words(pulses.size() * PULSE_MAX_WORDS);
+  std::vector<uint32_t> decoded(pulses.size());
+
+  // Encode
+  uint64_t encoded = 0;
+  size_t len = 0;
+  double elapsed = 0;
+  Clock::time_point start = Clock::now();
+  while (elapsed < seconds / 2) {
+    len = 0;
+    for (uint32_t p : pulses) {
+      pulseAppend(words.data(), &len, words.size(), p);
+    }
+    encoded += pulses.size();
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  double encoderate = encoded / elapsed;
+
+  // Decode
+  uint64_t read = 0;
+  elapsed = 0;
+  start = Clock::now();
+  while (elapsed < seconds / 2) {
+    PulseReader rd;
+    size_t n = 0;
+    pulseReaderInit(&rd, words.data(), len);
+    while (pulseNext(&rd, &decoded[n])) {
+      n++;
+    }
+    read += n;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  double decoderate = read / elapsed;
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < pulses.size(); i++) {
+    mismatches += decoded[i] != pulses[i];
+  }
+
+  printf("%zu captures, %zu pulses, %.3f words per pulse, %zu escaped\n", captures.size(), pulses.size(),
+         (double)len / pulses.size(), (len - pulses.size()) / 2);
+  printf("%.1f bytes per pulse, %.0f pulses per KB (%.0f with 4-byte samples)\n", 2.0 * len / pulses.size(),
+         1024.0 * pulses.size() / (2.0 * len), 1024.0 / 4);
+  printf("encode %.1f M pulses/s, decode %.1f M pulses/s\n", encoderate / 1e6, decoderate / 1e6);
+  if (mismatches) {
+    fprintf(stderr, "%zu pulses decoded wrong\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,218 @@
+/*
+  bench_storage - Log writes of the storage task against the open, append
+  and close per call they replaced
+
+  The log text of every capture is written in six calls, as often as
+  appendFile() used to be called per capture. The old way opens the log
+  for appending, writes, syncs and closes it on every call, like closing a
+  file on the SD card does. The storage task way keeps the file open,
+  collects the text in a write-behind buffer of STORAGE_BUFFER bytes,
+  writes whole buffers and syncs once every STORAGE_FLUSH_MS. Each runs
+  for the given time; the report gives captures/s and the write and sync
+  calls per capture.
+
+  The numbers depend on the file system of dir, the current directory by
+  default; a mounted SD card comes closest to the device.
+
+  Usage: bench_storage [-s seconds] [-d dir] [file...]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "synth.h"
+
+#define STORAGE_BUFFER    4096          // tasks.h
+#define STORAGE_FLUSH_MS  1000          // tasks.h
+#define CALLS             6             // appendFile() calls per capture
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+  uint64_t captures;
+  uint64_t writes;
+  uint64_t syncs;
+  uint64_t bytes;
+  double elapsed;
+} Run;
+
+// The log text of a capture, cut into the pieces it was written in.
+static std::vector<std::string> logPieces(const Capture *c) {
+  char *text = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&text, &len);
+  writeLogCapture(out, c);
+  fclose(out);
+
+  std::vector<std::string> pieces;
+  for (int i = 0; i < CALLS; i++) {
+    pieces.push_back(std::string(text + len * i / CALLS, len * (i + 1) / CALLS - len * i / CALLS));
+  }
+  free(text);
+  return pieces;
+}
+
+static bool writeAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool runAppendClose(const char *path, const std::vector<std::vector<std::string>> &logs, double seconds,
+                           Run *r) {
+  Clock::time_point start = Clock::now();
+
+  *r = Run();
+  unlink(path);
+  while (r->elapsed < seconds) {
+    for (const std::vector<std::string> &pieces : logs) {
+      for (const std::string &p : pieces) {
+        int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (fd < 0 || !writeAll(fd, p.data(), p.size())) {
+          perror(path);
+          return false;
+        }
+        fsync(fd);
+        close(fd);
+        r->writes++;
+        r->syncs++;
+        r->bytes += p.size();
+      }
+      r->captures++;
+      r->elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+      if (r->elapsed >= seconds) {
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+static bool runWriteBehind(const char *path, const std::vector<std::vector<std::string>> &logs, double seconds,
+                           Run *r) {
+  static char buf[STORAGE_BUFFER];
+  size_t len = 0;
+  Clock::time_point start = Clock::now();
+  Clock::time_point synctime = start;
+
+  *r = Run();
+  unlink(path);
+  int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+  while (r->elapsed < seconds) {
+    for (const std::vector<std::string> &pieces : logs) {
+      for (const std::string &p : pieces) {
+        const char *data = p.data();
+        size_t left = p.size();
+        while (left > 0) {
+          size_t part = left < STORAGE_BUFFER - len ? left : STORAGE_BUFFER - len;
+          memcpy(buf + len, data, part);
+          len += part;
+          data += part;
+          left -= part;
+          if (len == STORAGE_BUFFER) {
+            if (!writeAll(fd, buf, len)) {
+              perror(path);
+              return false;
+            }
+            r->writes++;
+            len = 0;
+          }
+        }
+        r->bytes += p.size();
+      }
+      r->captures++;
+      Clock::time_point now = Clock::now();
+      if (now - synctime >= std::chrono::milliseconds(STORAGE_FLUSH_MS)) {
+        if (len > 0 && writeAll(fd, buf, len)) {
+          r->writes++;
+          len = 0;
+        }
+        fsync(fd);
+        r->syncs++;
+        synctime = now;
+      }
+      r->elapsed = std::chrono::duration<double>(now - start).count();
+      if (r->elapsed >= seconds) {
+        break;
+      }
+    }
+  }
+  if (len > 0 && writeAll(fd, buf, len)) {
+    r->writes++;
+  }
+  fsync(fd);
+  r->syncs++;
+  close(fd);
+  r->elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  return true;
+}
+
+static void report(const char *name, const Run *r) {
+  printf("%-22s %8.0f captures/s, %5.2f writes and %6.4f syncs per capture, %.1f MB/s\n", name,
+         r->captures / r->elapsed, (double)r->writes / r->captures, (double)r->syncs / r->captures,
+         r->bytes / r->elapsed / 1e6);
+}
+
+int main(int argc, char **argv) {
+  double seconds = 4;
+  std::string dir = ".";
+  int a = 1;
+
+  for (; a + 1 < argc && argv[a][0] == '-'; a += 2) {
+    if (strcmp(argv[a], "-s") == 0) {
+      seconds = atof(argv[a + 1]);
+    } else if (strcmp(argv[a], "-d") == 0) {
+      dir = argv[a + 1];
+    } else {
+      fprintf(stderr, "usage: bench_storage [-s seconds] [-d dir] [file...]\n");
+      return 2;
+    }
+  }
+
+  std::vector<Capture> captures;
+  for (; a < argc; a++) {
+    loadCaptures(argv[a], &captures);
+  }
+  if (captures.empty()) {
+    synthCorpus(&captures, 200);
+  }
+  std::vector<std::vector<std::string>> logs;
+  size_t bytes = 0;
+  for (const Capture &c : captures) {
+    logs.push_back(logPieces(&c));
+    for (const std::string &p : logs.back()) {
+      bytes += p.size();
+    }
+  }
+
+  std::string path = dir + "/bench_storage.txt";
+  Run before, after;
+  if (!runAppendClose(path.c_str(), logs, seconds / 2, &before) ||
+      !runWriteBehind(path.c_str(), logs, seconds / 2, &after)) {
+    return 1;
+  }
+  unlink(path.c_str());
+
+  printf("%zu captures, %zu bytes of log text each on average, in %s\n", captures.size(), bytes / captures.size(),
+         dir.c_str());
+  report("open, append, close:", &before);
+  report("write-behind:", &after);
+  printf("%.1fx the captures/s\n", (after.captures / after.elapsed) / (before.captures / before.elapsed));
+  return 0;
+}
@@ -0,0 +1,333 @@
+/*
+  captures.h - Reading and writing captures for the host tools
+
+  Captures come from the text log the device writes to /logs.txt, or from
+  the binary .ecap container of ecap.h. loadCaptures() tells them apart by
+  the first bytes of the file.
+*/
+#ifndef CAPTURES_h
+#define CAPTURES_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "pulses.h"
+#include "ecap.h"
+
+typedef struct {
+  int line;                             // line of the Count= header, or record number in an .ecap
+  int module;                           // 0 when the log has no Module= line
+  std::string frequency;                // MHz as printed
+  int mod;
+  int rssi;
+  uint32_t time;                        // ms since boot, .ecap only
+  uint32_t rxbw;                        // Hz, .ecap only
+  uint32_t datarate;                    // Baud, .ecap only
+  std::vector<uint32_t> pulses;         // as printed, index 0 is the lead-in
+} Capture;
+
+static inline void captureInit(Capture *c) {
+  c->line = 0;
+  c->module = 0;
+  c->frequency.clear();
+  c->mod = -1;
+  c->rssi = 0;
+  c->time = 0;
+  c->rxbw = 0;
+  c->datarate = 0;
+  c->pulses.clear();
+}
+
+static inline bool readFile(const char *path, std::string *text) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+
+  char buf[65536];
+  size_t n;
+  text->clear();
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    text->append(buf, n);
+  }
+  fclose(in);
+  return true;
+}
+
+// Parses a text log. A capture is the first Count= line after a separator
+// and the pulse list below it; the Count= of "Rawdata corrected" is skipped.
+static inline void parseLog(const std::string &text, std::vector<Capture> *out) {
+  Capture cur;
+  bool header = false;                  // separator seen, capture not read yet
+  bool expect = false;                  // next line is the pulse list
+  int lineno = 0;
+  size_t pos = 0;
+
+  captureInit(&cur);
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    const char *line = text.c_str() + pos;
+    size_t len = end - pos;
+    lineno++;
+    pos = end + 1;
+
+    if (expect) {
+      expect = false;
+      bool sign = false;
+      const char *p = line;
+      const char *stop = line + len;
+      cur.pulses.clear();
+      while (p < stop) {
+        bool low = *p == '-';
+        if (low) {
+          p++;
+        }
+        char *next;
+        unsigned long t = strtoul(p, &next, 10);
+        if (next == p) {
+          break;
+        }
+        sign |= low;
+        cur.pulses.push_back(PULSE(!low, t));
+        p = next;
+        while (p < stop && (*p == ',' || *p == ' ' || *p == '\r')) {
+          p++;
+        }
+      }
+      // Logs from before signed pulses alternate, starting with the low gap
+      if (!sign) {
+        for (size_t i = 0; i < cur.pulses.size(); i++) {
+          cur.pulses[i] = PULSE(i % 2, PULSE_TIME(cur.pulses[i]));
+        }
+      }
+      if (cur.pulses.size() > 1) {
+        out->push_back(cur);
+      }
+      continue;
+    }
+    if (len >= 8 && strncmp(line, "--------", 8) == 0) {
+      header = true;
+      captureInit(&cur);
+      continue;
+    }
+    if (header && len > 7 && strncmp(line, "Module=", 7) == 0) {
+      std::string s(line, len);
+      size_t fq = s.find("Frequency=");
+      size_t md = s.find("Mod=");
+      size_t rs = s.find("RSSI=");
+      cur.module = atoi(line + 7);
+      if (fq != std::string::npos) {
+        cur.frequency = s.substr(fq + 10, s.find(' ', fq) - fq - 10);
+      }
+      if (md != std::string::npos) {
+        cur.mod = atoi(s.c_str() + md + 4);
+      }
+      if (rs != std::string::npos) {
+        cur.rssi = atoi(s.c_str() + rs + 5);
+      }
+      continue;
+    }
+    if (header && len > 6 && strncmp(line, "Count=", 6) == 0) {
+      header = false;
+      expect = true;
+      cur.line = lineno;
+    }
+  }
+}
+
+// Decodes the record at pos of an .ecap image whose records end at end.
+// Returns the record size, or 0 when no record starts there. *crcok tells
+// whether the body checked out.
+static inline size_t ecapRecord(const std::string &data, size_t pos, size_t end, int number, Capture *c,
+                         EcapDecoded *dec, bool *crcok) {
+  const uint8_t *p = (const uint8_t *)data.data() + pos;
+  size_t left = end - pos;
+
+  if (left < ECAP_RECORD_SIZE) {
+    return 0;
+  }
+  uint32_t body = ecapRecordBody(p);
+  if (body == 0 || left < ECAP_RECORD_SIZE + body + ECAP_CRC_SIZE) {
+    return 0;
+  }
+  const uint8_t *b = p + ECAP_RECORD_SIZE;
+  EcapMeta meta;
+  ecapMetaGet(b, &meta);
+  if (ECAP_META_SIZE + meta.words * 2 + ECAP_DECODED_SIZE != body) {
+    return 0;
+  }
+
+  char freq[24];
+  snprintf(freq, sizeof(freq), "%.2f", meta.frequency / 1e6);
+  captureInit(c);
+  c->line = number;
+  c->module = meta.module + 1;
+  c->frequency = freq;
+  c->mod = meta.mod;
+  c->rssi = meta.rssi;
+  c->time = meta.time;
+  c->rxbw = meta.rxbw;
+  c->datarate = meta.datarate;
+
+  std::vector<uint16_t> words(meta.words);
+  for (uint32_t i = 0; i < meta.words; i++) {
+    words[i] = ecapGet16(b + ECAP_META_SIZE + i * 2);
+  }
+  PulseReader rd;
+  uint32_t pulse;
+  pulseReaderInit(&rd, words.data(), words.size());
+  while (pulseNext(&rd, &pulse)) {
+    c->pulses.push_back(pulse);
+  }
+  if (dec != NULL) {
+    ecapDecodedGet(b + body - ECAP_DECODED_SIZE, dec);
+  }
+  *crcok = ecapCrc(0, b, body) == ecapGet32(b + body);
+  return ECAP_RECORD_SIZE + body + ECAP_CRC_SIZE;
+}
+
+// End of the records of an .ecap image: the index when it has a footer,
+// else the end of the data. *count and *index describe the footer.
+static inline size_t ecapRecordsEnd(const std::string &data, uint32_t *count, uint32_t *index) {
+  const uint8_t *p = (const uint8_t *)data.data();
+  size_t size = data.size();
+  uint32_t crc;
+
+  *count = 0;
+  *index = 0;
+  if (size >= ECAP_HEADER_SIZE + ECAP_FOOTER_SIZE &&
+      ecapFooterGet(p + size - ECAP_FOOTER_SIZE, count, index, &crc) &&
+      (uint64_t)*index + *count * 4ULL + ECAP_FOOTER_SIZE == size && *index >= ECAP_HEADER_SIZE &&
+      ecapCrc(0, p + *index, *count * 4) == crc) {
+    return *index;
+  }
+  *count = 0;
+  *index = 0;
+  return size;
+}
+
+// EcapRead of an .ecap image in memory.
+static inline bool ecapImageRead(void *ctx, uint32_t pos, uint8_t *buf, size_t len) {
+  const std::string *data = (const std::string *)ctx;
+  if (pos > data->size() || data->size() - pos < len) {
+    return false;
+  }
+  memcpy(buf, data->data() + pos, len);
+  return true;
+}
+
+// Reads every record of an .ecap image. Records that do not check out are
+// counted in *bad and skipped; damaged ones are passed over with ecapNext(),
+// like the device does, so records are numbered the same way. offsets, when
+// given, gets the position of every record read.
+static inline void parseEcap(const std::string &data, std::vector<Capture> *out, int *bad,
+                      std::vector<uint32_t> *offsets = NULL) {
+  uint32_t count, index;
+  uint32_t end = ecapRecordsEnd(data, &count, &index);
+  uint32_t pos = ECAP_HEADER_SIZE;
+  uint32_t next;
+  int number = 0;
+
+  while ((next = ecapNext(ecapImageRead, (void *)&data, pos, end)) < end) {
+    Capture c;
+    bool crcok = false;
+    size_t size = ecapRecord(data, next, end, number, &c, NULL, &crcok);
+    if (next != pos) {
+      (*bad)++;
+    }
+    number++;
+    if (crcok) {
+      out->push_back(c);
+      if (offsets != NULL) {
+        offsets->push_back(next);
+      }
+    } else {
+      (*bad)++;
+    }
+    pos = next + size;
+  }
+  if (pos + ECAP_RECORD_SIZE <= end) {
+    (*bad)++;
+  }
+}
+
+static inline bool isEcap(const std::string &data) {
+  return data.size() >= ECAP_HEADER_SIZE && ecapCheckHeader((const uint8_t *)data.data());
+}
+
+// Reads the captures of a text log or an .ecap file.
+static inline bool loadCaptures(const char *path, std::vector<Capture> *out) {
+  std::string data;
+  if (!readFile(path, &data)) {
+    return false;
+  }
+  if (isEcap(data)) {
+    int bad = 0;
+    parseEcap(data, out, &bad);
+    if (bad) {
+      fprintf(stderr, "%s: %d damaged records skipped\n", path, bad);
+    }
+  } else {
+    parseLog(data, out);
+  }
+  return true;
+}
+
+// Writes a capture the way printReceived() logs it.
+static inline void writeLogCapture(FILE *out, const Capture *c) {
+  fprintf(out, "-------------------------------------------------------\n");
+  fprintf(out, "Module=%d Frequency=%s Mod=%d RSSI=%d\nCount=%zu\n",
+          c->module ? c->module : 1, c->frequency.empty() ? "0.00" : c->frequency.c_str(), c->mod, c->rssi,
+          c->pulses.size());
+  for (uint32_t pulse : c->pulses) {
+    fprintf(out, "%s%u,", PULSE_LEVEL(pulse) ? "" : "-", (unsigned)PULSE_TIME(pulse));
+  }
+  fprintf(out, "\n");
+}
+
+// Appends one record, returns its size. symbol and dec come from the analysis.
+static inline size_t writeEcapRecord(FILE *out, const Capture *c, uint32_t symbol, const EcapDecoded *dec) {
+  std::vector<uint16_t> words;
+  uint16_t enc[PULSE_MAX_WORDS];
+  for (uint32_t pulse : c->pulses) {
+    size_t n = pulseEncode(pulse, enc);
+    words.insert(words.end(), enc, enc + n);
+  }
+
+  EcapMeta meta;
+  meta.time = c->time;
+  meta.module = c->module > 0 ? c->module - 1 : 0;
+  meta.mod = c->mod < 0 ? 0 : c->mod;
+  meta.rssi = c->rssi < -128 ? -128 : c->rssi > 127 ? 127 : c->rssi;
+  meta.flags = 0;
+  meta.frequency = (uint32_t)(atof(c->frequency.c_str()) * 1e6 + 0.5);
+  meta.rxbw = c->rxbw;
+  meta.datarate = c->datarate;
+  meta.symbol = symbol;
+  meta.pulses = c->pulses.size();
+  meta.words = words.size();
+
+  std::vector<uint8_t> rec(ECAP_RECORD_BYTES(meta.words));
+  ecapRecordPut(rec.data(), &meta, words.data(), dec);
+  fwrite(rec.data(), 1, rec.size(), out);
+  return rec.size();
+}
+
+// Appends the index of the records at the given offsets and the footer.
+static inline void writeEcapIndex(FILE *out, const std::vector<uint32_t> &offsets, uint32_t at) {
+  std::vector<uint8_t> index(offsets.size() * 4 + ECAP_FOOTER_SIZE);
+  for (size_t i = 0; i < offsets.size(); i++) {
+    ecapPut32(index.data() + i * 4, offsets[i]);
+  }
+  ecapFooter(index.data() + offsets.size() * 4, offsets.size(), at, ecapCrc(0, index.data(), offsets.size() * 4));
+  fwrite(index.data(), 1, index.size(), out);
+}
+
+#endif
@@ -0,0 +1,223 @@
+/*
+  ecapconv - Converts between the text log and the .ecap container
+
+  -o writes the captures of text logs or .ecap files to one .ecap file that
+  ends with an index; the symbol time and the decoded fields of every
+  record are filled in by the analysis of the firmware. -l writes captures
+  back in the text log format of printReceived(). -n reads one record with
+  the index, or by hopping over the record headers when there is none,
+  searching on past damaged records, without reading the rest of the file. -i appends the index to an .ecap
+  file written by the device.
+
+  Usage: ecapconv [-t tolerance] -o out.ecap file...
+         ecapconv -l file...
+         ecapconv -n frame file.ecap
+         ecapconv -i file.ecap
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "captures.h"
+
+static bool readAt(FILE *in, long pos, uint8_t *buf, size_t len) {
+  return fseek(in, pos, SEEK_SET) == 0 && fread(buf, 1, len, in) == len;
+}
+
+static bool fileRead(void *ctx, uint32_t pos, uint8_t *buf, size_t len) {
+  return readAt((FILE *)ctx, pos, buf, len);
+}
+
+static int toEcap(const AnalysisOptions *o, const char *path, char **inputs, int count) {
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return 1;
+  }
+
+  uint8_t header[ECAP_HEADER_SIZE];
+  std::vector<uint32_t> offsets;
+  uint32_t pos = ECAP_HEADER_SIZE;
+  ecapHeader(header);
+  fwrite(header, 1, sizeof(header), out);
+  for (int i = 0; i < count; i++) {
+    std::vector<Capture> captures;
+    if (!loadCaptures(inputs[i], &captures)) {
+      continue;
+    }
+    for (const Capture &c : captures) {
+      Result r;
+      EcapDecoded dec;
+      analyzeCapture(o, &c, &r);
+      resultDecoded(&r, &dec);
+      offsets.push_back(pos);
+      pos += writeEcapRecord(out, &c, r.valid ? r.symbol : 0, &dec);
+    }
+  }
+  writeEcapIndex(out, offsets, pos);
+  if (fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+  fprintf(stderr, "%s: %zu records\n", path, offsets.size());
+  return 0;
+}
+
+static int toLog(char **inputs, int count) {
+  for (int i = 0; i < count; i++) {
+    std::vector<Capture> captures;
+    if (!loadCaptures(inputs[i], &captures)) {
+      return 1;
+    }
+    for (const Capture &c : captures) {
+      writeLogCapture(stdout, &c);
+    }
+  }
+  return 0;
+}
+
+static int printFrame(const char *path, uint32_t n) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+
+  uint8_t buf[ECAP_FOOTER_SIZE];
+  uint32_t count, index, crc;
+  long pos = ECAP_HEADER_SIZE;
+  bool found = false;
+
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  if (!readAt(in, 0, buf, ECAP_HEADER_SIZE) || !ecapCheckHeader(buf)) {
+    fprintf(stderr, "%s: not an .ecap file\n", path);
+    fclose(in);
+    return 1;
+  }
+  if (size >= ECAP_HEADER_SIZE + ECAP_FOOTER_SIZE && readAt(in, size - ECAP_FOOTER_SIZE, buf, ECAP_FOOTER_SIZE) &&
+      ecapFooterGet(buf, &count, &index, &crc) && (long)index + count * 4L + ECAP_FOOTER_SIZE == size) {
+    found = n < count && readAt(in, index + n * 4L, buf, 4);
+    pos = found ? ecapGet32(buf) : 0;
+  } else {
+    uint8_t head[ECAP_RECORD_SIZE + ECAP_META_SIZE];
+    while ((pos = ecapNext(fileRead, in, pos, size)) < size && readAt(in, pos, head, sizeof(head))) {
+      if (n-- == 0) {
+        found = true;
+        break;
+      }
+      pos += ecapRecordAt(head, pos, size);
+    }
+  }
+
+  std::string record;
+  if (found && readAt(in, pos, buf, ECAP_RECORD_SIZE) && ecapRecordBody(buf) != 0) {
+    record.resize(ECAP_RECORD_SIZE + ecapRecordBody(buf) + ECAP_CRC_SIZE);
+    found = readAt(in, pos, (uint8_t *)&record[0], record.size());
+  } else {
+    found = false;
+  }
+  fclose(in);
+
+  Capture c;
+  EcapDecoded dec;
+  bool crcok = false;
+  if (!found || ecapRecord(record, 0, record.size(), n, &c, &dec, &crcok) == 0) {
+    fprintf(stderr, "%s: no such frame\n", path);
+    return 1;
+  }
+  writeLogCapture(stdout, &c);
+  if (!crcok) {
+    fprintf(stderr, "%s: frame at %ld fails its CRC\n", path, pos);
+    return 1;
+  }
+  return 0;
+}
+
+static int addIndex(const char *path) {
+  std::string data;
+  if (!readFile(path, &data)) {
+    return 1;
+  }
+  uint32_t count, index;
+  if (!isEcap(data)) {
+    fprintf(stderr, "%s: not an .ecap file\n", path);
+    return 1;
+  }
+  if (ecapRecordsEnd(data, &count, &index) != data.size()) {
+    fprintf(stderr, "%s: already indexed, %u records\n", path, count);
+    return 0;
+  }
+
+  std::vector<Capture> captures;
+  std::vector<uint32_t> offsets;
+  int bad = 0;
+  parseEcap(data, &captures, &bad, &offsets);
+  FILE *out = fopen(path, "ab");
+  if (!out) {
+    perror(path);
+    return 1;
+  }
+  writeEcapIndex(out, offsets, data.size());
+  if (fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+  fprintf(stderr, "%s: %zu records indexed, %d damaged left out\n", path, offsets.size(), bad);
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: ecapconv [-t tolerance] -o out.ecap file...\n"
+                  "       ecapconv -l file...\n"
+                  "       ecapconv -n frame file.ecap\n"
+                  "       ecapconv -i file.ecap\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  AnalysisOptions options = { DEFAULT_TOLERANCE, { 0, 0 }, { 0, 0 }, 0 };
+  const char *output = NULL;
+  char mode = 0;
+  long frame = 0;
+
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-'; a++) {
+    if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) {
+      options.tolerance = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+      mode = 'o';
+      output = argv[++a];
+    } else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+      mode = 'n';
+      frame = atol(argv[++a]);
+    } else if (strcmp(argv[a], "-l") == 0 || strcmp(argv[a], "-i") == 0) {
+      mode = argv[a][1];
+    } else {
+      usage();
+    }
+  }
+  if (a == argc || mode == 0) {
+    usage();
+  }
+
+  switch (mode) {
+  case 'o':
+    return toEcap(&options, output, argv + a, argc - a);
+  case 'l':
+    return toLog(argv + a, argc - a);
+  case 'n':
+    if (argc - a != 1 || frame < 0) {
+      usage();
+    }
+    return printFrame(argv[a], frame);
+  default:
+    if (argc - a != 1) {
+      usage();
+    }
+    return addIndex(argv[a]);
+  }
+}
@@ -0,0 +1,96 @@
+/*
+  synth.h - Synthetic captures for the host tests and benchmarks
+
+  Messages are built from a row of the protocols[] table of decoders.h, so
+  every fixed code family the firmware decodes can be generated without a
+  recorded corpus. Widths get a uniform jitter of +/- jitter percent.
+*/
+#ifndef SYNTH_h
+#define SYNTH_h
+
+#include <stdlib.h>
+#include <vector>
+
+#include "pulses.h"
+#include "decoders.h"
+#include "captures.h"
+
+#define SYNTH_PAUSE       31            // te of low after a message
+
+static inline uint32_t synthWidth(uint32_t width, int jitter) {
+  if (jitter <= 0) {
+    return width;
+  }
+  int pct = rand() % (2 * jitter + 1) - jitter;
+  return width + (int32_t)width * pct / 100;
+}
+
+// Appends one message of a protocol and the pause after it.
+static inline void synthMessage(Capture *c, const Protocol *pr, uint32_t te, uint32_t code, int bits, int jitter) {
+  bool lowfirst = pr->flags & PROTO_LOW_FIRST;
+
+  if (pr->start) {
+    c->pulses.push_back(PULSE(1, synthWidth(pr->start * te, jitter)));
+  }
+  for (int b = bits - 1; b >= 0; b--) {
+    const uint8_t *shape = (code >> b) & 1 ? pr->one : pr->zero;
+    c->pulses.push_back(PULSE(!lowfirst, synthWidth(shape[0] * te, jitter)));
+    c->pulses.push_back(PULSE(lowfirst, synthWidth(shape[1] * te, jitter)));
+  }
+  if (pr->stop) {
+    c->pulses.push_back(PULSE(1, synthWidth(pr->stop * te, jitter)));
+  }
+  // Low first bits end on a high, the pause is a low of its own. High first
+  // bits end on a low, unless a stop pulse follows.
+  if (lowfirst || pr->stop) {
+    c->pulses.push_back(PULSE(0, SYNTH_PAUSE * te));
+  } else {
+    c->pulses.back() = PULSE(0, SYNTH_PAUSE * te);
+  }
+}
+
+// A random code the protocol can carry, valid trits for tri-state rows.
+static inline uint32_t synthCode(const Protocol *pr, int bits) {
+  uint32_t code = 0;
+  for (int b = 0; b < bits; b += 2) {
+    uint32_t pair = rand() & 3;
+    if (pr->flags & PROTO_TRISTATE) {
+      while (pair == 2) {
+        pair = rand() & 3;
+      }
+    }
+    code = code << 2 | pair;
+  }
+  return bits % 2 ? code >> 1 : code;
+}
+
+// A capture as the device logs it: the lead-in gap, then repeats of one
+// message.
+static inline void synthCapture(Capture *c, const Protocol *pr, uint32_t te, uint32_t code, int bits, int repeats,
+                                int jitter) {
+  captureInit(c);
+  c->frequency = "433.92";
+  c->pulses.push_back(PULSE(0, 100000));
+  for (int i = 0; i < repeats; i++) {
+    synthMessage(c, pr, te, code, bits, jitter);
+  }
+}
+
+// A corpus of count captures of all five fixed code families, 3 to 12
+// repeats each with 10% jitter, the same on every run.
+static inline void synthCorpus(std::vector<Capture> *out, int count) {
+  static const char *const names[] = { "PT2262", "EV1527", "Princeton", "CAME", "Nice FLO" };
+  static const int bits[] = { 24, 24, 28, 12, 12 };
+  static const uint32_t te[] = { 350, 300, 400, 320, 700 };
+
+  srand(1);
+  for (int i = 0; i < count; i++) {
+    int f = i % 5;
+    const Protocol *pr = protocolFind(names[f]);
+    Capture c;
+    synthCapture(&c, pr, te[f], synthCode(pr, bits[f]), bits[f], 3 + rand() % 10, 10);
+    out->push_back(c);
+  }
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+  test_cluster - Pulse width clustering must not depend on the pulse order
+
+  pulseCluster() has to find the same classes, counts, means and extremes
+  however the pulses of a frame are ordered. Every capture of a synthetic
+  corpus is clustered as captured and with its pulses shuffled a few
+  times, the lead-in staying in front. A few hand-made frames check that
+  widths close to each other end in one class and that no class of the
+  linear bins spans the tolerance.
+
+  Usage: test_cluster
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+
+#include "analysis.h"
+#include "synth.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+static void cluster(const std::vector<uint32_t> &pulses, uint32_t tolerance, PulseClasses *out) {
+  std::vector<uint16_t> words(pulses.size() * PULSE_MAX_WORDS);
+  size_t len = 0;
+  for (uint32_t p : pulses) {
+    pulseAppend(words.data(), &len, words.size(), p);
+  }
+  pulseCluster(words.data(), len, tolerance, out);
+}
+
+static bool sameClasses(const PulseClasses *a, const PulseClasses *b) {
+  if (a->count != b->count || a->shortest != b->shortest || a->unclustered != b->unclustered) {
+    return false;
+  }
+  for (int i = 0; i < a->count; i++) {
+    const PulseClass *x = &a->classes[i];
+    const PulseClass *y = &b->classes[i];
+    if (x->min != y->min || x->max != y->max || x->count != y->count || x->sum != y->sum || x->mean != y->mean) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Lead-in, then the widths as given with alternating levels
+static std::vector<uint32_t> frame(std::initializer_list<uint32_t> widths) {
+  std::vector<uint32_t> pulses;
+  int level = 1;
+  pulses.push_back(PULSE(0, 100000) | EDGE_FRAME_START);
+  for (uint32_t w : widths) {
+    pulses.push_back(PULSE(level, w));
+    level = !level;
+  }
+  return pulses;
+}
+
+static void testOrder() {
+  PulseClasses a, b;
+
+  cluster(frame({ 300, 450, 150 }), 200, &a);
+  cluster(frame({ 150, 300, 450 }), 200, &b);
+  CHECK(sameClasses(&a, &b), "300 450 150 and 150 300 450 cluster differently");
+  CHECK(a.count == 2, "%d classes of 150 300 450, want 2", a.count);
+
+  cluster(frame({ 400, 410, 420, 800, 810, 390, 1600 }), 200, &a);
+  CHECK(a.count == 3, "%d classes, want 3", a.count);
+  CHECK(a.classes[0].count == 4 && a.classes[0].min == 390 && a.classes[0].max == 420 && a.classes[0].mean == 405,
+        "first class %u pulses %u-%u mean %u", (unsigned)a.classes[0].count, (unsigned)a.classes[0].min,
+        (unsigned)a.classes[0].max, (unsigned)a.classes[0].mean);
+  CHECK(a.shortest == 390, "shortest %u", (unsigned)a.shortest);
+}
+
+static void testSpan() {
+  std::vector<uint32_t> pulses = frame({});
+  PulseClasses out;
+
+  for (uint32_t w = 100; w < 3000; w += 7) {
+    pulses.push_back(PULSE(pulses.size() % 2, w));
+  }
+  cluster(pulses, 200, &out);
+  for (int i = 0; i < out.count; i++) {
+    const PulseClass *c = &out.classes[i];
+    CHECK(c->max - c->min < 200, "class %d spans %u-%u", i, (unsigned)c->min, (unsigned)c->max);
+  }
+}
+
+static void testShuffled() {
+  std::vector<Capture> captures;
+  std::mt19937 rng(5);
+  int frames = 0;
+
+  synthCorpus(&captures, 1000);
+  for (const Capture &c : captures) {
+    PulseClasses want, got;
+    std::vector<uint32_t> pulses = c.pulses;
+
+    cluster(pulses, DEFAULT_TOLERANCE, &want);
+    for (int s = 0; s < 4; s++) {
+      std::shuffle(pulses.begin() + 1, pulses.end(), rng);
+      cluster(pulses, DEFAULT_TOLERANCE, &got);
+      CHECK(sameClasses(&want, &got), "capture %d: classes change with the pulse order", frames);
+    }
+    frames++;
+  }
+  CHECK(frames > 0, "no captures");
+}
+
+int main() {
+  testOrder();
+  testSpan();
+  testShuffled();
+  if (failures) {
+    fprintf(stderr, "test_cluster: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_cluster: ok\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+  test_correlator - Preamble and sync word search of correlator.h
+
+  A pattern is planted with a given number of flipped bits at every bit
+  offset of a frame, up to the last offset it fits at, and has to be found
+  there with the errors it was given, and not when they exceed maxerrors.
+  On random frames patternSearch() has to report the same matches as a
+  plain search that builds the window one bit at a time, for pattern
+  lengths from 1 to 64 bits and search starts inside the frame.
+
+  Usage: test_correlator
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "correlator.h"
+
+#define FRAME_BYTES       40
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+static int bitAt(const uint8_t *bits, int i) {
+  return (bits[i / 8] >> (7 - i % 8)) & 1;
+}
+
+static void setBit(uint8_t *bits, int i, int v) {
+  bits[i / 8] = (bits[i / 8] & ~(0x80 >> (i % 8))) | (v << (7 - i % 8));
+}
+
+// The search one bit at a time
+static int plainSearch(const uint8_t *bits, int nbits, int from, const BitPattern *p, int maxerrors, BitMatch *out,
+                       int max) {
+  BitMatch best = { 0, 0 };
+  bool have = false;
+  int found = 0;
+
+  for (int offset = from; offset + p->len <= nbits; offset++) {
+    if (have && offset >= best.offset + p->len) {
+      out[found++] = best;
+      have = false;
+      if (found == max) {
+        return found;
+      }
+    }
+    int errors = 0;
+    for (int b = 0; b < p->len; b++) {
+      errors += bitAt(bits, offset + b) != (int)((p->bits >> (p->len - 1 - b)) & 1);
+    }
+    if (errors <= maxerrors && (!have || errors < best.errors)) {
+      best.offset = offset;
+      best.errors = errors;
+      have = true;
+    }
+  }
+  if (have) {
+    out[found++] = best;
+  }
+  return found;
+}
+
+static void testPlanted() {
+  BitPattern p = { 0, 0 };
+  uint8_t bits[FRAME_BYTES];
+  BitMatch match[4];
+
+  CHECK(patternParse("0x2DD4A5F0C3", &p) && p.len == 40, "pattern parse");
+  for (int nbits = 60; nbits <= FRAME_BYTES * 8; nbits += 37) {
+    for (int offset = 0; offset + p.len <= nbits; offset++) {
+      for (int flips = 0; flips <= 3; flips++) {
+        // A background the pattern matches nowhere with 3 errors
+        memset(bits, 0x00, sizeof(bits));
+        for (int b = 0; b < p.len; b++) {
+          setBit(bits, offset + b, (p.bits >> (p.len - 1 - b)) & 1);
+        }
+        for (int f = 0; f < flips; f++) {
+          int b = offset + f * 11 + 3;
+          setBit(bits, b, !bitAt(bits, b));
+        }
+        int n = patternSearch(bits, nbits, 0, &p, 2, match, 4);
+        if (flips > 2) {
+          CHECK(n == 0, "%d bits, offset %d: %d flips found", nbits, offset, flips);
+        } else {
+          CHECK(n == 1 && match[0].offset == offset && match[0].errors == flips,
+                "%d bits, offset %d, %d flips: %d matches, first at %d with %d errors", nbits, offset, flips, n,
+                n ? match[0].offset : -1, n ? match[0].errors : -1);
+        }
+      }
+    }
+    // One bit short of the end of the frame
+    {
+      memset(bits, 0x00, sizeof(bits));
+      for (int b = 0; b < p.len - 1; b++) {
+        setBit(bits, nbits - p.len + 1 + b, (p.bits >> (p.len - 1 - b)) & 1);
+      }
+      int n = patternSearch(bits, nbits, 0, &p, 0, match, 4);
+      CHECK(n == 0, "%d bits: pattern past the end found at %d", nbits, n ? match[0].offset : -1);
+    }
+  }
+}
+
+static void testRandom() {
+  uint8_t bits[FRAME_BYTES];
+  BitMatch want[8], got[8];
+
+  srand(18);
+  for (int round = 0; round < 200000; round++) {
+    BitPattern p;
+    int nbits = 1 + rand() % (FRAME_BYTES * 8);
+    int from = rand() % 4 ? 0 : rand() % nbits;
+    int maxerrors = rand() % 4;
+    int max = 1 + rand() % 8;
+
+    p.len = 1 + rand() % PATTERN_BITS;
+    p.bits = ((uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ rand()) & (p.len == 64 ? ~0ULL : (1ULL << p.len) - 1);
+    // Mostly repeats of the pattern, so there is something to find
+    for (int i = 0; i < FRAME_BYTES * 8; i++) {
+      int b = (p.bits >> (p.len - 1 - i % p.len)) & 1;
+      setBit(bits, i, rand() % 8 ? b : !b);
+    }
+    int nw = plainSearch(bits, nbits, from, &p, maxerrors, want, max);
+    int ng = patternSearch(bits, nbits, from, &p, maxerrors, got, max);
+    bool same = nw == ng;
+    for (int i = 0; same && i < nw; i++) {
+      same = want[i].offset == got[i].offset && want[i].errors == got[i].errors;
+    }
+    CHECK(same, "%d bits from %d, %d bit pattern, %d errors: %d matches, plain search %d", nbits, from, p.len,
+          maxerrors, ng, nw);
+    if (failures > 10) {
+      return;
+    }
+  }
+}
+
+int main() {
+  testPlanted();
+  testRandom();
+  if (failures) {
+    fprintf(stderr, "test_correlator: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_correlator: ok\n");
+  return 0;
+}
@@ -0,0 +1,159 @@
+/*
+  test_decode - Fixed code decoders and the per code repeat count
+
+  Usage: test_decode
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "analysis.h"
+#include "synth.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+static const AnalysisOptions options = { DEFAULT_TOLERANCE, { 0, 0 }, { 0, 0 }, 0 };
+
+typedef struct {
+  const char *name;
+  uint32_t te;
+  int bits;
+  uint32_t code;                        // 0 = random
+} Family;
+
+// EV1527 needs a 10 pair, or the PT2262 row takes the code as trits
+static const Family families[] = {
+  { "PT2262", 350, 24, 0 },
+  { "EV1527", 300, 24, 0x8A5C3E },
+  { "Princeton", 400, 28, 0 },
+  { "CAME", 320, 12, 0 },
+  { "Nice FLO", 700, 12, 0 },
+};
+
+// Every family decodes from a jittered train, each repeat counted.
+static void testFamilies() {
+  for (const Family &f : families) {
+    const Protocol *pr = protocolFind(f.name);
+    for (int run = 0; run < 20; run++) {
+      uint32_t code = f.code ? f.code : synthCode(pr, f.bits);
+      Capture c;
+      Result r;
+      synthCapture(&c, pr, f.te, code, f.bits, 5, 8);
+      analyzeCapture(&options, &c, &r);
+      CHECK(r.decoded.protocol == pr, "%s %X: decoded as %s", f.name, (unsigned)code,
+            r.decoded.protocol ? r.decoded.protocol->name : "nothing");
+      CHECK(r.decoded.code == code && r.decoded.bits == f.bits, "%s %X: code %X/%d", f.name, (unsigned)code,
+            (unsigned)r.decoded.code, r.decoded.bits);
+      CHECK(r.decodes == 5, "%s %X: %d of 5 repeats", f.name, (unsigned)code, r.decodes);
+    }
+  }
+}
+
+// A code sent once ahead of the repeats of another one does not win.
+static void testMostRepeats() {
+  const Protocol *pr = protocolFind("EV1527");
+  Capture c;
+  Result r;
+
+  synthCapture(&c, pr, 300, 0x8A5C3E, 24, 1, 0);
+  for (int i = 0; i < 3; i++) {
+    synthMessage(&c, pr, 300, 0x9F0001, 24, 0);
+  }
+  analyzeCapture(&options, &c, &r);
+  CHECK(r.decoded.code == 0x9F0001, "reported %X, want 9F0001", (unsigned)r.decoded.code);
+  CHECK(r.decodes == 3, "%d repeats, want 3", r.decodes);
+  CHECK(r.line.nbits == 24, "line payload of %d bits", r.line.nbits);
+}
+
+static void testTally() {
+  CodeTally t;
+  Decoded shorter = { protocolFind("Princeton"), 0x123, 12, 400 };
+  Decoded longer = { protocolFind("EV1527"), 0x8A5C3E, 24, 300 };
+  int repeats;
+
+  // Ties go to the longer code, whichever came first
+  codeTallyReset(&t);
+  codeTallyAdd(&t, &shorter);
+  codeTallyAdd(&t, &longer);
+  CHECK(codeTallyBest(&t, &repeats)->bits == 24 && repeats == 1, "tie not broken by length");
+  codeTallyReset(&t);
+  codeTallyAdd(&t, &longer);
+  codeTallyAdd(&t, &shorter);
+  CHECK(codeTallyBest(&t, &repeats)->bits == 24, "tie not broken by length");
+  codeTallyAdd(&t, &shorter);
+  CHECK(codeTallyBest(&t, &repeats)->bits == 12 && repeats == 2, "more repeats lost to a longer code");
+
+  // Noise fills the table, the repeating code keeps its count
+  codeTallyReset(&t);
+  codeTallyAdd(&t, &longer);
+  codeTallyAdd(&t, &longer);
+  for (int i = 0; i < 3 * TALLY_CODES; i++) {
+    Decoded noise = { protocolFind("CAME"), (uint32_t)i, 12, 320 };
+    codeTallyAdd(&t, &noise);
+  }
+  codeTallyAdd(&t, &longer);
+  CHECK(codeTallyBest(&t, &repeats)->code == 0x8A5C3E && repeats == 3, "repeating code pushed out by noise");
+  CHECK(codeTallyBest(&t, &repeats) != NULL && t.n == TALLY_CODES, "table holds %d codes", t.n);
+
+  codeTallyReset(&t);
+  CHECK(codeTallyBest(&t, &repeats) == NULL && repeats == 0, "empty table reports a code");
+}
+
+static void testLineTally() {
+  LineTally t;
+  LineCode a = {};
+  LineCode b = {};
+  int repeats;
+
+  a.code = LINE_PWM;
+  a.score = 100;
+  b.code = LINE_PWM;
+  b.score = 95;
+  for (int i = 0; i < 24; i++) {
+    linePut(&a, i % 3 == 0);
+    linePut(&b, i % 5 == 0);
+  }
+
+  // The better scored payload once does not beat one repeated twice
+  lineTallyReset(&t);
+  lineTallyAdd(&t, &a);
+  lineTallyAdd(&t, &b);
+  lineTallyAdd(&t, &b);
+  const LineCode *best = lineTallyBest(&t, &repeats);
+  CHECK(best != NULL && lineSame(best, &b) && repeats == 2, "line payload with more repeats lost");
+
+  // Equal repeats: the longer payload, then the better score
+  LineCode c = a;
+  linePut(&c, true);
+  lineTallyReset(&t);
+  lineTallyAdd(&t, &a);
+  lineTallyAdd(&t, &c);
+  CHECK(lineTallyBest(&t, &repeats)->nbits == 25, "tie not broken by length");
+  lineTallyReset(&t);
+  lineTallyAdd(&t, &b);
+  lineTallyAdd(&t, &a);
+  CHECK(lineTallyBest(&t, &repeats)->score == 100, "tie not broken by score");
+}
+
+int main() {
+  srand(5);
+  testFamilies();
+  testMostRepeats();
+  testTally();
+  testLineTally();
+  if (failures) {
+    fprintf(stderr, "test_decode: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_decode: ok\n");
+  return 0;
+}
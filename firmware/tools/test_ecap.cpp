@@ -0,0 +1,137 @@
+/*
+  test_ecap - Records of ecap.h and finding them again in a damaged file
+
+  Records are written with ecapRecordPut() the way ecapStore() does and
+  read back with parseEcap(). A file then gets the damage the device could
+  do before records were queued whole: a buffer of a record dropped, or a
+  record cut short by a failed write. ecapNext() has to find every record
+  after the damage, and the offsets it walks have to be the ones the device
+  notes in captures.idx.
+
+  Usage: test_ecap
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "synth.h"
+
+#define LOG_CHUNK_SIZE 1024             // log buffer size in tasks.h
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+// A record of a synthetic capture, as ecapStore() builds it.
+static std::string record(uint32_t time) {
+  const Protocol *pr = protocolFind("EV1527");
+  Capture c;
+  std::vector<uint16_t> words;
+  uint16_t enc[PULSE_MAX_WORDS];
+  EcapMeta meta = {};
+  EcapDecoded dec = {};
+
+  synthCapture(&c, pr, 300, synthCode(pr, 24), 24, 2 + rand() % 20, 10);
+  for (uint32_t pulse : c.pulses) {
+    size_t n = pulseEncode(pulse, enc);
+    words.insert(words.end(), enc, enc + n);
+  }
+  meta.time = time;
+  meta.frequency = 433920000;
+  meta.pulses = c.pulses.size();
+  meta.words = words.size();
+  dec.linecode = ECAP_NO_LINE;
+
+  std::string rec(ECAP_RECORD_BYTES(meta.words), 0);
+  size_t len = ecapRecordPut((uint8_t *)&rec[0], &meta, words.data(), &dec);
+  CHECK(len == rec.size(), "record of %zu bytes, %zu expected", len, rec.size());
+  return rec;
+}
+
+// Offsets of the records as ecapSeek() walks a file without an index.
+static std::vector<uint32_t> walk(const std::string &data) {
+  std::vector<uint32_t> offsets;
+  uint32_t size = data.size();
+  uint32_t pos = ECAP_HEADER_SIZE;
+  uint8_t head[ECAP_RECORD_SIZE + ECAP_META_SIZE];
+
+  while ((pos = ecapNext(ecapImageRead, (void *)&data, pos, size)) < size &&
+         ecapImageRead((void *)&data, pos, head, sizeof(head))) {
+    offsets.push_back(pos);
+    pos += ecapRecordAt(head, pos, size);
+  }
+  return offsets;
+}
+
+static void testDamage(const char *name, size_t cut, size_t len) {
+  uint8_t header[ECAP_HEADER_SIZE];
+  std::string data;
+  std::vector<uint32_t> offsets;                // captures.idx of the device
+
+  ecapHeader(header);
+  data.assign((const char *)header, sizeof(header));
+  for (int i = 0; i < 40; i++) {
+    std::string rec = record(i);
+    if (i == 17) {
+      // The damaged record, not in the index
+      rec.erase(cut < rec.size() ? cut : rec.size() / 2, len);
+    } else {
+      offsets.push_back(data.size());
+    }
+    data += rec;
+  }
+
+  std::vector<Capture> captures;
+  std::vector<uint32_t> parsed;
+  int bad = 0;
+  parseEcap(data, &captures, &bad, &parsed);
+  CHECK(captures.size() == 39 && bad == 1, "%s: %zu records read, %d bad", name, captures.size(), bad);
+  CHECK(parsed == offsets, "%s: parseEcap() offsets differ from the index", name);
+  for (size_t i = 0; i < captures.size(); i++) {
+    CHECK(captures[i].time == (i < 17 ? i : i + 1), "%s: record %zu has time %u", name, i,
+          (unsigned)captures[i].time);
+  }
+  std::vector<uint32_t> walked = walk(data);
+  CHECK(walked == offsets, "%s: walked %zu records, %zu in the index", name, walked.size(), offsets.size());
+}
+
+// A record that ends the file part way is not reported.
+static void testTruncated() {
+  uint8_t header[ECAP_HEADER_SIZE];
+  std::string data;
+
+  ecapHeader(header);
+  data.assign((const char *)header, sizeof(header));
+  data += record(0);
+  uint32_t second = data.size();
+  data += record(1);
+  std::string cut = data.substr(0, data.size() - 3);
+
+  CHECK(walk(data).size() == 2 && walk(data)[1] == second, "whole file: %zu records", walk(data).size());
+  CHECK(walk(cut).size() == 1, "cut file: %zu records", walk(cut).size());
+  CHECK(walk(data.substr(0, ECAP_HEADER_SIZE)).empty(), "empty file has records");
+}
+
+int main() {
+  srand(11);
+  testDamage("dropped buffer", 1000, LOG_CHUNK_SIZE);
+  testDamage("cut short", 600, 100000);
+  testDamage("lost header", 0, 6);
+  testTruncated();
+  if (failures) {
+    fprintf(stderr, "test_ecap: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_ecap: ok\n");
+  return 0;
+}
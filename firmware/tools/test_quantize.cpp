@@ -0,0 +1,111 @@
+/*
+  test_quantize - The integer symbol quantizer against the float rounding
+  it replaced
+
+  signalanalyse() used to divide every pulse by the symbol time in float
+  and round the fraction half up by hand. quantize() has to give the same
+  symbol count for every width: all widths up to 20 symbols for symbol
+  times up to 2000 us, random widths up to 2 s, and every pulse of a
+  synthetic corpus at the symbol time pulseCluster() finds for it.
+
+  Usage: test_quantize
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "analysis.h"
+#include "synth.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+// The rounding of the old signalanalyse()
+static uint32_t floatRound(uint32_t duration, int symbol) {
+  float r = (float)duration / symbol;
+  int calculate = r;
+  r = r - calculate;
+  r *= 10;
+  if (r >= 5) {
+    calculate += 1;
+  }
+  return calculate;
+}
+
+static uint64_t mismatches = 0;
+
+static void compare(const SymbolQuantizer *q, uint32_t duration) {
+  uint32_t want = floatRound(duration, q->symbol);
+  uint32_t got = quantize(q, duration);
+  if (got != want && mismatches++ < 10) {
+    CHECK(false, "%u us at symbol %u: %u symbols, float rounding %u", (unsigned)duration, (unsigned)q->symbol,
+          (unsigned)got, (unsigned)want);
+  }
+}
+
+static void testRange() {
+  for (uint32_t symbol = 1; symbol <= 2000; symbol++) {
+    SymbolQuantizer q;
+    quantizerInit(&q, symbol);
+    for (uint32_t d = 0; d <= 20 * symbol; d++) {
+      compare(&q, d);
+    }
+  }
+}
+
+static void testRandom() {
+  srand(12);
+  for (int i = 0; i < 2000000; i++) {
+    SymbolQuantizer q;
+    uint32_t symbol = 1 + rand() % 30000;
+    uint32_t duration = ((uint32_t)rand() << 8 ^ rand()) % 2000000;
+    quantizerInit(&q, symbol);
+    compare(&q, duration);
+  }
+}
+
+static void testCorpus() {
+  std::vector<Capture> captures;
+  size_t pulses = 0;
+
+  synthCorpus(&captures, 2000);
+  for (const Capture &c : captures) {
+    std::vector<uint16_t> words(c.pulses.size() * PULSE_MAX_WORDS);
+    size_t len = 0;
+    PulseClasses classes;
+    SymbolQuantizer q;
+    for (uint32_t p : c.pulses) {
+      pulseAppend(words.data(), &len, words.size(), p);
+    }
+    pulseCluster(words.data(), len, DEFAULT_TOLERANCE, &classes);
+    if (classes.count == 0 || classes.classes[0].mean == 0) {
+      continue;
+    }
+    quantizerInit(&q, classes.classes[0].mean);
+    for (size_t i = 1; i < c.pulses.size(); i++) {
+      compare(&q, PULSE_TIME(c.pulses[i]));
+      pulses++;
+    }
+  }
+  CHECK(pulses > 0, "no pulses quantized");
+}
+
+int main() {
+  testRange();
+  testRandom();
+  testCorpus();
+  if (failures) {
+    fprintf(stderr, "test_quantize: %d failures, %llu widths differ\n", failures, (unsigned long long)mismatches);
+    return 1;
+  }
+  printf("test_quantize: ok\n");
+  return 0;
+}
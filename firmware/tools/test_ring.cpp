@@ -0,0 +1,238 @@
+/*
+  test_ring - Stress test of the edge ring between the RX interrupt and the
+  RF task
+
+  A producer thread stands in for the interrupt handler and pushes bursts of
+  pulses with ringPush(), the first pulse of every burst tagged as a frame
+  start. The consumer assembles frames with frameFill() of framer.h like
+  checkReceived() does, without the triggers of framePulse(): a frame start
+  popped while a frame is open ends that frame and is held back to start the
+  next one. Every finished frame is "analysed"
+  for a while before the consumer pops again, so the ring has to carry the
+  bursts that arrive meanwhile.
+
+  Afterwards every pulse the ring took must show up in exactly one frame, in
+  order, the pulses it refused must match the dropped count, and no frame may
+  hold pulses of two bursts unless the frame start between them was dropped.
+  The dropped-edge counts are printed per run.
+
+  Usage: test_ring
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "framer.h"
+
+#define SAMPLE_WORDS 4000               // samplewords in capture.h
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+  uint32_t pulse;
+  int burst;
+  bool kept;                            // ringPush() took it
+} Sent;
+
+// Bursts of random length and widths. Every 16th pulse is longer than the
+// one word encoding, so escaped records cross the ring wrap as well.
+static std::vector<Sent> makeBursts(int bursts, unsigned seed) {
+  std::vector<Sent> sent;
+  srand(seed);
+  for (int b = 0; b < bursts; b++) {
+    int len = 20 + rand() % 2000;
+    uint32_t gap = 100000 + rand() % 50000;
+    sent.push_back({ (uint32_t)(PULSE(0, gap) | EDGE_FRAME_START), b, false });
+    for (int i = 1; i < len; i++) {
+      uint32_t width = i % 16 == 0 ? 40000 + rand() % 10000 : 100 + rand() % 1500;
+      sent.push_back({ (uint32_t)PULSE(i % 2, width), b, false });
+    }
+  }
+  return sent;
+}
+
+typedef struct {
+  std::vector<uint32_t> pulses;
+  bool full;                            // ended because the buffer was full
+} Frame;
+
+static void produce(EdgeRing *ring, std::vector<Sent> *sent, double rate, std::atomic<bool> *done) {
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < sent->size(); i++) {
+    Clock::time_point due = start + std::chrono::nanoseconds((long long)(i * 1e9 / rate));
+    while (Clock::now() < due) {
+    }
+    (*sent)[i].kept = ringPush(ring, (*sent)[i].pulse);
+  }
+  done->store(true, std::memory_order_release);
+}
+
+typedef struct {
+  uint16_t sample[SAMPLE_WORDS];
+  size_t len;
+  int count;
+  bool full;
+} Assembly;
+
+// framePulse() without triggers: pulses go to the frame until a frame start
+// arrives, which completes the frame and is held.
+static int assemble(void *ctx, uint32_t pulse) {
+  Assembly *a = (Assembly *)ctx;
+
+  if (frameSplits(pulse, a->count)) {
+    return FRAME_SPLIT;
+  }
+  a->full = frameAppend(a->sample, SAMPLE_WORDS, &a->len, &a->count, pulse);
+  return a->full ? FRAME_ENDED : FRAME_OPEN;
+}
+
+static void consume(EdgeRing *ring, std::vector<Frame> *frames, int analyse, std::atomic<bool> *done) {
+  static Assembly a;
+  uint32_t held = 0;
+  uint32_t pulse;
+
+  a.len = 0;
+  a.count = 0;
+  a.full = false;
+  for (;;) {
+    bool finished = done->load(std::memory_order_acquire);
+    bool complete = frameFill(ring, &held, assemble, &a);
+    if (!complete && finished && ring->head == ring->tail) {
+      complete = a.count > 0;
+      if (!complete) {
+        return;
+      }
+    }
+    if (!complete) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Analysis and logging of the frame; capture goes on meanwhile
+    Clock::time_point until = Clock::now() + std::chrono::microseconds(analyse);
+    while (Clock::now() < until) {
+    }
+    Frame frame;
+    PulseReader rd;
+    pulseReaderInit(&rd, a.sample, a.len);
+    while (pulseNext(&rd, &pulse)) {
+      frame.pulses.push_back(pulse);
+    }
+    frame.full = a.full;
+    frames->push_back(frame);
+    a.len = 0;
+    a.count = 0;
+    a.full = false;
+  }
+}
+
+static void verify(const EdgeRing *ring, const std::vector<Sent> &sent, const std::vector<Frame> &frames,
+                   uint32_t *dropped) {
+  std::vector<const Sent *> kept;
+  *dropped = 0;
+  for (const Sent &s : sent) {
+    if (s.kept) {
+      kept.push_back(&s);
+    } else {
+      (*dropped)++;
+    }
+  }
+  CHECK(*dropped == ring->dropped, "%u pulses refused, ring counted %u", (unsigned)*dropped,
+        (unsigned)ring->dropped);
+
+  size_t k = 0;
+  for (size_t f = 0; f < frames.size(); f++) {
+    const std::vector<uint32_t> &frame = frames[f].pulses;
+    bool continued = f > 0 && frames[f - 1].full;
+    CHECK(!frame.empty(), "frame %zu is empty", f);
+    for (size_t i = 0; i < frame.size(); i++, k++) {
+      if (k >= kept.size()) {
+        CHECK(false, "frame %zu has %zu pulses more than were kept", f, frame.size() - i);
+        return;
+      }
+      if (frame[i] != kept[k]->pulse) {
+        CHECK(false, "frame %zu pulse %zu: %08x, want %08x", f, i, (unsigned)frame[i], (unsigned)kept[k]->pulse);
+        return;
+      }
+      CHECK((i == 0 && !continued) == ((frame[i] & EDGE_FRAME_START) != 0),
+            "frame %zu pulse %zu: frame start out of place", f, i);
+      // Two bursts in one frame only when the start of the second was lost
+      if (i > 0 && kept[k]->burst != kept[k - 1]->burst) {
+        const Sent *start = kept[k];
+        while (start > sent.data() && start->burst == kept[k]->burst) {
+          start--;
+        }
+        start++;
+        CHECK(!start->kept, "frame %zu joins bursts %d and %d", f, kept[k - 1]->burst, kept[k]->burst);
+      }
+    }
+  }
+  CHECK(k == kept.size(), "%zu of %zu kept pulses reached a frame", k, kept.size());
+}
+
+// Threads at a fixed edge rate, analysing every frame for analyse us.
+static void testStress(const char *name, double rate, int analyse) {
+  EdgeRing *ring = new EdgeRing();
+  std::vector<Sent> sent = makeBursts(60, 7 + analyse);
+  std::vector<Frame> frames;
+  std::atomic<bool> done(false);
+  uint32_t dropped;
+
+  ringReset(ring);
+  std::thread consumer(consume, ring, &frames, analyse, &done);
+  std::thread producer(produce, ring, &sent, rate, &done);
+  producer.join();
+  consumer.join();
+  verify(ring, sent, frames, &dropped);
+
+  printf("%-10s %8.0f edges/s, %6d us per frame: %zu edges, %zu frames, %u dropped (%.2f%%)\n", name, rate, analyse,
+         sent.size(), frames.size(), (unsigned)dropped, 100.0 * dropped / sent.size());
+  delete ring;
+}
+
+// Deterministic: a whole burst arrives while the previous frame is still in
+// the consumer, then both come out complete.
+static void testBackToBack() {
+  EdgeRing *ring = new EdgeRing();
+  std::vector<Sent> sent = makeBursts(2, 1);
+  std::vector<Frame> frames;
+  std::atomic<bool> done(true);
+  uint32_t dropped;
+
+  ringReset(ring);
+  for (Sent &s : sent) {
+    s.kept = ringPush(ring, s.pulse);
+  }
+  consume(ring, &frames, 0, &done);
+  verify(ring, sent, frames, &dropped);
+  CHECK(frames.size() == 2, "%zu frames from 2 bursts", frames.size());
+  delete ring;
+}
+
+int main() {
+  testBackToBack();
+  testStress("idle", 50000, 0);
+  testStress("busy", 200000, 2000);
+  testStress("overload", 1000000, 20000);
+  if (failures) {
+    fprintf(stderr, "test_ring: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_ring: ok\n");
+  return 0;
+}
@@ -0,0 +1,161 @@
+/*
+  test_rmt - Drives the RMT decode path of edgering.h from rmtSimulate()
+
+  Synthetic pulse trains are packed into RMT symbol words, split into blocks
+  the size of the receive memory, unpacked by rmtDecodeBlock() through the
+  glitch filter into the edge ring and read back with ringPop(). Blocks cut
+  short by a full channel memory have to be told from blocks ended by idle.
+
+  Usage: test_rmt
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "edgering.h"
+
+#define RMT_SYMBOLS 256                 // symbols per block, as in firmware.ino
+#define MIN_PULSE   20                  // RMT backend floor
+#define FRAME_GAP   100000
+#define RMT_IDLE_US 32000               // idle time that ends a block, as in firmware.ino
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+static EdgeRing ring;
+
+// Pushes durations through the RMT path as one receive block, gap before it.
+static void feed(GlitchFilter *f, const std::vector<uint32_t> &durations, bool level, uint32_t gap) {
+  uint32_t symbols[RMT_SYMBOLS];
+  CHECK(durations.size() <= RMT_SYMBOLS * 2 - 2, "%zu periods do not fit one block", durations.size());
+  size_t words = rmtSimulate(durations.data(), durations.size(), level, symbols);
+  size_t periods = rmtDecodeBlock(f, &ring, symbols, words, gap, FRAME_GAP, MIN_PULSE);
+  CHECK(periods == durations.size(), "decoded %zu of %zu periods", periods, durations.size());
+}
+
+static std::vector<uint32_t> drain(GlitchFilter *f) {
+  std::vector<uint32_t> out;
+  uint32_t pulse;
+  if (f->pending) {
+    ringPush(&ring, f->pending);
+    f->pending = 0;
+  }
+  while (ringPop(&ring, &pulse)) {
+    out.push_back(pulse);
+  }
+  return out;
+}
+
+// Clean train: every period comes out with its level, the lead-in gap is
+// tagged as a frame start and durations past the RMT counter are clamped.
+static void testClean() {
+  GlitchFilter f = {};
+  std::vector<uint32_t> durations;
+  srand(1);
+  for (int i = 0; i < RMT_SYMBOLS * 2 - 2; i++) {
+    durations.push_back(MIN_PULSE + rand() % 2000);
+  }
+  durations[300] = 40000;
+
+  ringReset(&ring);
+  feed(&f, durations, true, 150000);
+  std::vector<uint32_t> out = drain(&f);
+
+  CHECK(out.size() == durations.size() + 1, "%zu pulses for %zu periods", out.size(), durations.size());
+  if (out.size() != durations.size() + 1) {
+    return;
+  }
+  CHECK(out[0] & EDGE_FRAME_START, "lead-in not tagged as frame start");
+  CHECK(!PULSE_LEVEL(out[0]), "lead-in has the level of the first period");
+  CHECK(PULSE_TIME(out[0]) == 150000, "lead-in %u us", (unsigned)PULSE_TIME(out[0]));
+  for (size_t i = 0; i < durations.size(); i++) {
+    uint32_t want = durations[i] > 0x7FFF ? 0x7FFF : durations[i];
+    CHECK(PULSE_TIME(out[i + 1]) == want, "period %zu: %u us, want %u", i, (unsigned)PULSE_TIME(out[i + 1]),
+          (unsigned)want);
+    CHECK(PULSE_LEVEL(out[i + 1]) == (i % 2 == 0), "period %zu has the wrong level", i);
+    CHECK(!(out[i + 1] & EDGE_FRAME_START), "period %zu tagged as frame start", i);
+  }
+  CHECK(ring.dropped == 0, "%u edges dropped", (unsigned)ring.dropped);
+}
+
+// A runt inside a pulse is joined with the pulse around it, so levels keep
+// alternating and the widths add up.
+static void testRunts() {
+  GlitchFilter f = {};
+  std::vector<uint32_t> durations = { 500, 1000, 300, 5, 295, 1000, 500 };
+
+  ringReset(&ring);
+  feed(&f, durations, true, 0);
+  std::vector<uint32_t> out = drain(&f);
+
+  // The zero lead-in gap is a runt too, with nothing pending to join
+  uint32_t want[] = { 500, 1000, 600, 1000, 500 };
+  CHECK(out.size() == 5, "%zu pulses", out.size());
+  for (size_t i = 0; i < out.size() && i < 5; i++) {
+    CHECK(PULSE_TIME(out[i]) == want[i], "pulse %zu: %u us, want %u", i, (unsigned)PULSE_TIME(out[i]), (unsigned)want[i]);
+    CHECK(PULSE_LEVEL(out[i]) == (i % 2 == 0), "pulse %zu has the wrong level", i);
+  }
+  CHECK(f.runts == 2, "%u runts, want 2", (unsigned)f.runts);
+}
+
+// A long burst arrives in blocks separated by the RMT idle time. Once the
+// ring is full whole pulses are dropped and counted.
+static void testOverflow() {
+  GlitchFilter f = {};
+  std::vector<uint32_t> durations(RMT_SYMBOLS * 2 - 2, 400);
+  size_t blocks = CAPTURE_RING_SIZE / durations.size() + 2;
+
+  ringReset(&ring);
+  for (size_t b = 0; b < blocks; b++) {
+    feed(&f, durations, true, RMT_IDLE_US);
+  }
+  std::vector<uint32_t> out = drain(&f);
+
+  size_t sent = blocks * (durations.size() + 1);
+  CHECK(out.size() + ring.dropped == sent, "%zu kept + %u dropped != %zu", out.size(), (unsigned)ring.dropped, sent);
+  CHECK(out.size() == CAPTURE_RING_SIZE, "%zu kept, ring holds %d", out.size(), CAPTURE_RING_SIZE);
+  for (size_t i = 0; i < out.size(); i++) {
+    size_t k = i % (durations.size() + 1);
+    uint32_t want = k == 0 ? RMT_IDLE_US : 400;
+    CHECK(PULSE_TIME(out[i]) == want, "pulse %zu: %u us, want %u", i, (unsigned)PULSE_TIME(out[i]), (unsigned)want);
+    CHECK(PULSE_LEVEL(out[i]) == (k % 2 == 1), "pulse %zu has the wrong level", i);
+  }
+}
+
+// A block with its end marker ended by idle. One that fills the channel
+// memory without a marker was cut short, one that fills it with the marker in
+// its last word was not.
+static void testBlockEnd() {
+  uint32_t symbols[RMT_SYMBOLS + 1];
+  std::vector<uint32_t> durations(RMT_SYMBOLS * 2, 400);
+
+  size_t words = rmtSimulate(durations.data(), 20, true, symbols);
+  CHECK(rmtBlockIdle(symbols, words, RMT_SYMBOLS), "short block not idle");
+  words = rmtSimulate(durations.data(), RMT_SYMBOLS * 2 - 1, true, symbols);
+  CHECK(words == RMT_SYMBOLS && rmtBlockIdle(symbols, words, RMT_SYMBOLS), "full block with marker not idle");
+  rmtSimulate(durations.data(), RMT_SYMBOLS * 2, true, symbols);
+  CHECK(!rmtBlockIdle(symbols, RMT_SYMBOLS, RMT_SYMBOLS), "cut block taken as idle");
+  CHECK(rmtBlockIdle(symbols, 0, RMT_SYMBOLS), "empty block not idle");
+}
+
+int main() {
+  testClean();
+  testRunts();
+  testOverflow();
+  testBlockEnd();
+  if (failures) {
+    fprintf(stderr, "test_rmt: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_rmt: ok\n");
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+  test_tune - Auto-tune and FSK estimate helpers of analyzer.h
+
+  Usage: test_tune
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "analyzer.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+// Every filter of the table is its own step, and values the web page takes
+// land on the filter setRxBW() would pick.
+static void testBandwidthStep() {
+  for (size_t i = 0; i < RXBW_COUNT; i++) {
+    CHECK(bandwidthStep(rxBandwidths[i]) == (int)(RXBW_COUNT - 1 - i), "%.2f kHz: step %d", rxBandwidths[i],
+          bandwidthStep(rxBandwidths[i]));
+  }
+  CHECK(bandwidthStep(200) == bandwidthStep(rxBandwidths[7]), "200 kHz is not the 203 kHz filter");
+  CHECK(bandwidthStep(58) == bandwidthStep(58.04f), "58 kHz is not the narrowest filter");
+  CHECK(bandwidthStep(2000) == 0, "2 MHz is not the widest filter");
+  CHECK(bandwidthStep(270.8333f) == bandwidthStep(270.83f), "rounding of the table value changes the step");
+}
+
+// The estimate is always a table value, so a retune leaves the step stable.
+static void testEstimate() {
+  for (uint32_t symbol = 20; symbol < 5000; symbol += 7) {
+    float kbaud = rateEstimate(symbol);
+    for (int mod = 0; mod <= 2; mod += 2) {
+      float bw = bandwidthEstimate(kbaud, mod, 20, 433.92f);
+      CHECK(bandwidthStep(bw) == bandwidthStep(bandwidthEstimate(kbaud, mod, 20, 433.92f)), "unstable step");
+      bool found = false;
+      for (size_t i = 0; i < RXBW_COUNT; i++) {
+        found |= bw == rxBandwidths[i];
+      }
+      CHECK(found, "%.2f kHz is not a CC1101 filter", bw);
+    }
+  }
+}
+
+// Percentiles of long captures keep the shape of the readings, where a
+// saturated bin used to let the rare values take over.
+static void testFreqPercentile() {
+  FreqSamples f;
+  int low = 0;
+
+  freqReset(&f);
+  srand(9);
+  for (int i = 0; i < 20000; i++) {
+    bool rare = rand() % 100 < 8;
+    freqAdd(&f, rare ? 20 : -20);
+    low += !rare;
+  }
+  CHECK(f.samples == 20000, "%d samples", f.samples);
+  CHECK(f.sum == -20 * low + 20 * (20000 - low), "sum %d", (int)f.sum);
+  CHECK(freqPercentile(&f, 10) == -20, "10th percentile %d", freqPercentile(&f, 10));
+  CHECK(freqPercentile(&f, 90) == -20, "90th percentile %d, 8%% of the readings are 20", freqPercentile(&f, 90));
+  CHECK(freqPercentile(&f, 95) == 20, "95th percentile %d", freqPercentile(&f, 95));
+
+  // Short captures count exactly
+  freqReset(&f);
+  for (int i = -50; i < 50; i++) {
+    freqAdd(&f, i);
+  }
+  CHECK(freqPercentile(&f, 10) == -41 && freqPercentile(&f, 90) == 39, "percentiles %d %d", freqPercentile(&f, 10),
+        freqPercentile(&f, 90));
+}
+
+int main() {
+  testBandwidthStep();
+  testEstimate();
+  testFreqPercentile();
+  if (failures) {
+    fprintf(stderr, "test_tune: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_tune: ok\n");
+  return 0;
+}
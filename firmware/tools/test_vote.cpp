@@ -0,0 +1,133 @@
+/*
+  test_vote - Repeat voting of analyzer.h, on its own and through the
+  analysis of a whole capture
+
+  Usage: test_vote
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                       \
+  do {                                         \
+    if (!(cond)) {                             \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);            \
+      fprintf(stderr, "\n");                   \
+      failures++;                              \
+    }                                          \
+  } while (0)
+
+static FrameVote vote;
+
+static void voteFrame(const std::string &bits) {
+  for (char c : bits) {
+    voteBit(&vote, c == '1');
+  }
+  voteEnd(&vote);
+}
+
+static std::string voted() {
+  std::string s;
+  for (int i = 0; i < voteLength(&vote); i++) {
+    s += voteMajority(&vote, i) ? '1' : '0';
+  }
+  return s;
+}
+
+static std::string randomBits(int n) {
+  std::string s;
+  for (int i = 0; i < n; i++) {
+    s += rand() % 2 ? '1' : '0';
+  }
+  return s;
+}
+
+// A truncated first transmission is replaced by the first full repeat and
+// is not counted against the vote.
+static void testTruncatedFirst() {
+  for (int repeats = 2; repeats <= 20; repeats++) {
+    std::string frame = randomBits(64);
+    voteReset(&vote);
+    voteFrame(frame.substr(40));
+    for (int i = 0; i < repeats; i++) {
+      voteFrame(frame);
+    }
+    CHECK(vote.repeats == repeats, "%d repeats counted as %d", repeats, vote.repeats);
+    CHECK(vote.rejected == 0, "%d repeats: %d rejected", repeats, vote.rejected);
+    CHECK(voted() == frame, "%d repeats: voted %s", repeats, voted().c_str());
+  }
+}
+
+// A repeat hit by interference after the vote has settled is rejected.
+static void testInterference() {
+  std::string frame = randomBits(64);
+  voteReset(&vote);
+  for (int i = 0; i < 5; i++) {
+    voteFrame(i == 3 ? randomBits(64) : frame);
+  }
+  CHECK(vote.repeats == 4, "4 clean repeats counted as %d", vote.repeats);
+  CHECK(vote.rejected == 1, "%d rejected, want 1", vote.rejected);
+  CHECK(voted() == frame, "voted %s", voted().c_str());
+}
+
+// PWM capture as the device logs it: a high of 1 or 3 symbols and a low of
+// 3 or 1 per bit, frames separated by a long low.
+static void appendFrame(Capture *c, const std::string &bits, uint32_t symbol) {
+  for (size_t i = 0; i < bits.size(); i++) {
+    bool one = bits[i] == '1';
+    c->pulses.push_back(PULSE(1, (one ? 3 : 1) * symbol));
+    c->pulses.push_back(PULSE(0, i + 1 < bits.size() ? (one ? 1 : 3) * symbol : 30 * symbol));
+  }
+}
+
+static std::string symbolBits(const std::string &bits) {
+  std::string s;
+  for (size_t i = 0; i < bits.size(); i++) {
+    s += bits[i] == '1' ? "111" : "1";
+    if (i + 1 < bits.size()) {
+      s += bits[i] == '1' ? "0" : "000";
+    }
+  }
+  return s;
+}
+
+static void testCapture() {
+  AnalysisOptions o = { DEFAULT_TOLERANCE, { 0, 0 }, { 0, 0 }, 0 };
+  std::string bits = randomBits(24);
+  Capture c;
+  Result r;
+
+  captureInit(&c);
+  c.pulses.push_back(PULSE(0, 100000));
+  appendFrame(&c, bits.substr(10), 350);
+  for (int i = 0; i < 6; i++) {
+    appendFrame(&c, bits, 350);
+  }
+  analyzeCapture(&o, &c, &r);
+
+  CHECK(r.valid, "capture not analysed");
+  CHECK(r.symbol == 350, "symbol %u us", (unsigned)r.symbol);
+  CHECK(r.repeats == 6, "6 repeats counted as %d", r.repeats);
+  CHECK(r.rejected == 0, "%d rejected", r.rejected);
+  CHECK(r.vote == symbolBits(bits), "voted %s, want %s", r.vote.c_str(), symbolBits(bits).c_str());
+  CHECK(r.confidence == 100, "confidence %d", r.confidence);
+}
+
+int main() {
+  srand(3);
+  testTruncatedFirst();
+  testInterference();
+  testCapture();
+  if (failures) {
+    fprintf(stderr, "test_vote: %d failures\n", failures);
+    return 1;
+  }
+  printf("test_vote: ok\n");
+  return 0;
+}